@@ -0,0 +1,98 @@
+/******************************************************************************
+ *
+ *
+ * @file buffer-pool.cpp
+ *
+ * Size-classed pool of sds_alloc buffers, see buffer-pool.h.
+ *
+ *
+ *****************************************************************************/
+#include "buffer-pool.h"
+#include "sds_lib.h"
+
+using namespace std;
+
+static const size_t minClassBytes = 4096;
+
+// rounds up to the next of 4096, 5120, 6144, 7168, 8192, 10240, ...
+static size_t classBytes(size_t bytes) {
+  size_t size = minClassBytes;
+  while(size < bytes) {
+    size_t octave = minClassBytes;
+    while(octave * 2 <= size)
+      octave *= 2;
+    size += octave / 4;
+  }
+  return size;
+}
+
+DmaBuffer & DmaBuffer::operator=(DmaBuffer && o) noexcept {
+  if(this != &o) {
+    reset();
+    pool = o.pool;
+    ptr = o.ptr;
+    bytes = o.bytes;
+    o.ptr = 0;
+  }
+  return *this;
+}
+
+void DmaBuffer::reset() {
+  if(ptr)
+    pool->release(ptr, bytes);
+  ptr = 0;
+}
+
+DmaBufferPool::~DmaBufferPool() {
+  trim();
+}
+
+DmaBuffer DmaBufferPool::acquire(size_t bytes) {
+  const size_t size = classBytes(bytes);
+  {
+    lock_guard<mutex> g(lock);
+    vector<void *> & list = idle[size];
+    if(!list.empty()) {
+      void * p = list.back();
+      list.pop_back();
+      return DmaBuffer(this, p, size);
+    }
+  }
+  void * p = sds_alloc(size);
+  if(!p)
+    throw "Failed to allocate host buffer";
+  lock_guard<mutex> g(lock);
+  total += size;
+  return DmaBuffer(this, p, size);
+}
+
+void DmaBufferPool::release(void * ptr, size_t bytes) {
+  if(bytes > maxIdle) {
+    sds_free(ptr);
+    lock_guard<mutex> g(lock);
+    total -= bytes;
+    return;
+  }
+  lock_guard<mutex> g(lock);
+  idle[bytes].push_back(ptr);
+}
+
+void DmaBufferPool::trim() {
+  lock_guard<mutex> g(lock);
+  for(map<size_t, vector<void *> >::iterator it = idle.begin(); it != idle.end(); ++it) {
+    for(unsigned int i = 0; i < it->second.size(); i++)
+      sds_free(it->second[i]);
+    total -= it->first * it->second.size();
+  }
+  idle.clear();
+}
+
+size_t DmaBufferPool::reserved() const {
+  lock_guard<mutex> g(lock);
+  return total;
+}
+
+DmaBufferPool & DmaBufferPoolInstance() {
+  static DmaBufferPool * pool = new DmaBufferPool;
+  return *pool;
+}
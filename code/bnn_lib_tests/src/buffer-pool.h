@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ *
+ * @file buffer-pool.h
+ *
+ * Pool of host buffers for the accelerator's input and output. Buffers come
+ * from sds_alloc (physically contiguous and usable for DMA on the board) in
+ * size classes of a quarter octave, at most 25% larger than requested. A
+ * released buffer goes back to the free list of its class and is handed out
+ * again on the next request of that class, so once the buffers of a loop
+ * exist it does not allocate any more. Buffers above a size limit (batches
+ * rather than per-frame buffers) are freed on release instead, so a pool
+ * that lives until exit does not keep them.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stddef.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+class DmaBufferPool;
+
+// a pool buffer, returned to its pool when the handle goes out of scope
+class DmaBuffer {
+public:
+  DmaBuffer() : pool(0), ptr(0), bytes(0) {}
+  DmaBuffer(DmaBuffer && o) noexcept : pool(o.pool), ptr(o.ptr), bytes(o.bytes) { o.ptr = 0; }
+  DmaBuffer & operator=(DmaBuffer && o) noexcept;
+  ~DmaBuffer() { reset(); }
+
+  // start of the buffer, viewed as an array of T
+  template<typename T> T * as() const { return (T *)ptr; }
+  void * data() const { return ptr; }
+  // usable size, at least what was requested
+  size_t size() const { return bytes; }
+  explicit operator bool() const { return ptr != 0; }
+
+  // gives the buffer back to the pool early
+  void reset();
+
+private:
+  friend class DmaBufferPool;
+  DmaBuffer(DmaBufferPool * pool, void * ptr, size_t bytes) : pool(pool), ptr(ptr), bytes(bytes) {}
+  DmaBuffer(const DmaBuffer &);
+  DmaBuffer & operator=(const DmaBuffer &);
+
+  DmaBufferPool * pool;
+  void * ptr;
+  size_t bytes;
+};
+
+class DmaBufferPool {
+public:
+  // released buffers of more than maxIdleBytes are freed, not kept
+  explicit DmaBufferPool(size_t maxIdleBytes = 1 << 20) : maxIdle(maxIdleBytes), total(0) {}
+  ~DmaBufferPool();
+
+  // a buffer of at least bytes bytes, throws if sds_alloc fails
+  DmaBuffer acquire(size_t bytes);
+  // frees the buffers not currently handed out
+  void trim();
+
+  // bytes allocated from sds_alloc, in use or idle
+  size_t reserved() const;
+
+private:
+  friend class DmaBuffer;
+  void release(void * ptr, size_t bytes);
+
+  std::map<size_t, std::vector<void *> > idle;   // by class size
+  const size_t maxIdle;
+  size_t total;
+  mutable std::mutex lock;
+};
+
+// the pool shared by the host code, never destroyed so that handles with
+// static storage can still give their buffers back at exit
+DmaBufferPool & DmaBufferPoolInstance();
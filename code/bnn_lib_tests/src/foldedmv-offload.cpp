@@ -39,10 +39,21 @@
  *
  *****************************************************************************/
 #include "foldedmv-offload.h"
+#include "parampack.h"
 #include <string.h>
 #include <iostream>
 #include <stdlib.h>
 #include <unistd.h>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BIN_X86
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BIN_NEON
+#include <arm_neon.h>
+#endif
 
 using namespace tiny_cnn;
 using namespace std;
@@ -67,35 +78,168 @@ unsigned int paddedSize(unsigned int in, unsigned int padTo) {
     return in + padTo - (in % padTo);
 }
 
+static_assert(std::is_same<tiny_cnn::float_t, float>::value, "the packing kernels expect float vec_t");
+
+// Sign packing kernels for whole words, 64 values each. They compare
+// (x >= 0) instead of taking the raw sign bit, so that -0 packs to 1 and NaN
+// to 0 like in the scalar loop.
+typedef void (*bin_pack_fn)(const float * in, ExtMemWord * out, unsigned int words);
+typedef void (*bin_unpack_fn)(const ExtMemWord * in, float * out, unsigned int words);
+
+static ExtMemWord packBits(const float * in, unsigned int n) {
+  ExtMemWord w = 0;
+  for(unsigned int i = 0; i < n; i++)
+    w |= (ExtMemWord)(in[i] >= 0) << i;
+  return w;
+}
+
+static void unpackBits(ExtMemWord w, float * out, unsigned int n) {
+  for(unsigned int i = 0; i < n; i++)
+    out[i] = (w >> i) & 1 ? 1 : -1;
+}
+
+static void binPackScalar(const float * in, ExtMemWord * out, unsigned int words) {
+  for(unsigned int w = 0; w < words; w++)
+    out[w] = packBits(in + w * bitsPerExtMemWord, bitsPerExtMemWord);
+}
+
+static void binUnpackScalar(const ExtMemWord * in, float * out, unsigned int words) {
+  for(unsigned int w = 0; w < words; w++)
+    unpackBits(in[w], out + w * bitsPerExtMemWord, bitsPerExtMemWord);
+}
+
+#ifdef BIN_X86
+// vcmpps straight into a mask register, 16 bits per compare
+__attribute__((target("avx512f")))
+static void binPackAvx512(const float * in, ExtMemWord * out, unsigned int words) {
+  const __m512 zero = _mm512_setzero_ps();
+  for(unsigned int w = 0; w < words; w++, in += 64) {
+    ExtMemWord v = 0;
+    for(unsigned int j = 0; j < 4; j++)
+      v |= (ExtMemWord)_mm512_cmp_ps_mask(_mm512_loadu_ps(in + 16 * j), zero, _CMP_GE_OQ) << (16 * j);
+    out[w] = v;
+  }
+}
+
+__attribute__((target("avx512f")))
+static void binUnpackAvx512(const ExtMemWord * in, float * out, unsigned int words) {
+  const __m512 one = _mm512_set1_ps(1), minusOne = _mm512_set1_ps(-1);
+  for(unsigned int w = 0; w < words; w++, out += 64)
+    for(unsigned int j = 0; j < 4; j++)
+      _mm512_storeu_ps(out + 16 * j, _mm512_mask_blend_ps((__mmask16)(in[w] >> (16 * j)), minusOne, one));
+}
+
+// vcmpps + vmovmskps, 8 bits per compare
+__attribute__((target("avx2")))
+static void binPackAvx2(const float * in, ExtMemWord * out, unsigned int words) {
+  const __m256 zero = _mm256_setzero_ps();
+  for(unsigned int w = 0; w < words; w++, in += 64) {
+    ExtMemWord v = 0;
+    for(unsigned int j = 0; j < 8; j++)
+      v |= (ExtMemWord)(unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(in + 8 * j), zero, _CMP_GE_OQ)) << (8 * j);
+    out[w] = v;
+  }
+}
+
+// each lane tests its own bit of a broadcast byte; +1 and -1 only differ in
+// the sign bit, so a set bit flips the sign of -1
+__attribute__((target("avx2")))
+static void binUnpackAvx2(const ExtMemWord * in, float * out, unsigned int words) {
+  const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  const __m256 minusOne = _mm256_set1_ps(-1), sign = _mm256_set1_ps(-0.0f);
+  for(unsigned int w = 0; w < words; w++, out += 64)
+    for(unsigned int j = 0; j < 8; j++) {
+      const __m256i b = _mm256_set1_epi32((int)((in[w] >> (8 * j)) & 0xff));
+      const __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(b, bits), bits);
+      _mm256_storeu_ps(out + 8 * j, _mm256_xor_ps(minusOne, _mm256_and_ps(_mm256_castsi256_ps(set), sign)));
+    }
+}
+#endif
+
+#ifdef BIN_NEON
+// vcge masks narrowed to bytes, weighted by their bit and summed pairwise,
+// 8 bits per step
+static void binPackNeon(const float * in, ExtMemWord * out, unsigned int words) {
+  const uint8x8_t weights = vcreate_u8(0x8040201008040201ULL);
+  const float32x4_t zero = vdupq_n_f32(0);
+  for(unsigned int w = 0; w < words; w++, in += 64) {
+    ExtMemWord v = 0;
+    for(unsigned int j = 0; j < 8; j++) {
+      const uint16x4_t lo = vmovn_u32(vcgeq_f32(vld1q_f32(in + 8 * j), zero));
+      const uint16x4_t hi = vmovn_u32(vcgeq_f32(vld1q_f32(in + 8 * j + 4), zero));
+      uint8x8_t m = vand_u8(vmovn_u16(vcombine_u16(lo, hi)), weights);
+      m = vpadd_u8(m, m);
+      m = vpadd_u8(m, m);
+      m = vpadd_u8(m, m);
+      v |= (ExtMemWord)vget_lane_u8(m, 0) << (8 * j);
+    }
+    out[w] = v;
+  }
+}
+
+// the same with vtst
+static void binUnpackNeon(const ExtMemWord * in, float * out, unsigned int words) {
+  static const uint32_t bitsLo[4] = {1, 2, 4, 8}, bitsHi[4] = {16, 32, 64, 128};
+  const uint32x4_t lo = vld1q_u32(bitsLo), hi = vld1q_u32(bitsHi);
+  const uint32x4_t minusOne = vreinterpretq_u32_f32(vdupq_n_f32(-1)), sign = vdupq_n_u32(0x80000000u);
+  for(unsigned int w = 0; w < words; w++, out += 64)
+    for(unsigned int j = 0; j < 8; j++) {
+      const uint32x4_t b = vdupq_n_u32((uint32_t)(in[w] >> (8 * j)) & 0xff);
+      vst1q_f32(out + 8 * j, vreinterpretq_f32_u32(veorq_u32(minusOne, vandq_u32(vtstq_u32(b, lo), sign))));
+      vst1q_f32(out + 8 * j + 4, vreinterpretq_f32_u32(veorq_u32(minusOne, vandq_u32(vtstq_u32(b, hi), sign))));
+    }
+}
+#endif
+
+struct BinKernels {
+  bin_pack_fn pack;
+  bin_unpack_fn unpack;
+};
+
+static BinKernels selectBinKernels() {
+#ifdef BIN_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    return {binPackAvx512, binUnpackAvx512};
+  if(__builtin_cpu_supports("avx2"))
+    return {binPackAvx2, binUnpackAvx2};
+#endif
+#ifdef BIN_NEON
+  return {binPackNeon, binUnpackNeon};
+#endif
+  return {binPackScalar, binUnpackScalar};
+}
+
+static const BinKernels & binKernels() {
+  static const BinKernels k = selectBinKernels();
+  return k;
+}
+
 // binarize an array of floating point values according to their sign and
 // pack into a stream of bits
 void binarizeAndPack(const vec_t & in, ExtMemWord * out, unsigned int inBufSize) {
-  if(in.size() / bitsPerExtMemWord > inBufSize)
+  const unsigned int full = in.size() / bitsPerExtMemWord, rest = in.size() % bitsPerExtMemWord;
+  const unsigned int used = full + (rest ? 1 : 0);
+  if(used > inBufSize)
     throw "Not enough space in input buffer";
-  // first, fill the target buffer with padding data
-  memset(out, FOLDEDMV_INPUT_PADCHAR, inBufSize * sizeof(ExtMemWord));
-  // now clear/set each bit position as needed
-  for(unsigned int i=0; i < in.size(); i++) {
-      if(in[i] >= 0) {
-          // set bit
-          out[i / bitsPerExtMemWord] |= ((ExtMemWord)1 << (i % bitsPerExtMemWord));
-      } else {
-          // clear bit
-          out[i / bitsPerExtMemWord] &= ~((ExtMemWord)1 << (i % bitsPerExtMemWord));
-      }
+  binKernels().pack(in.data(), out, full);
+  // the bits past the end of the input keep the padding
+  ExtMemWord pad;
+  memset(&pad, FOLDEDMV_INPUT_PADCHAR, sizeof(pad));
+  if(rest) {
+    const ExtMemWord mask = ((ExtMemWord)1 << rest) - 1;
+    out[full] = (pad & ~mask) | packBits(&in[full * bitsPerExtMemWord], rest);
   }
+  memset(out + used, FOLDEDMV_INPUT_PADCHAR, (inBufSize - used) * sizeof(ExtMemWord));
 }
 
 // unpack a stream of bit and debinarize them into -1 and +1 floating point
 // values (where a 0 bit is -1 and 1 bit is +1)
 void unpackAndDebinarize(const ExtMemWord * in, vec_t &out) {
-  for(unsigned int i=0; i < out.size(); i++) {
-      if((in[i / bitsPerExtMemWord] >> (i % bitsPerExtMemWord)) & 0x1) {
-          out[i] = 1;
-      } else {
-          out[i] = -1;
-        }
-    }
+  const unsigned int full = out.size() / bitsPerExtMemWord, rest = out.size() % bitsPerExtMemWord;
+  binKernels().unpack(in, out.data(), full);
+  if(rest)
+    unpackBits(in[full], &out[full * bitsPerExtMemWord], rest);
 }
 
 
@@ -110,7 +254,8 @@ std::vector<unsigned int> testPrebinarized_nolabel(std::vector<vec_t> & imgs, co
   const unsigned int psi = paddedSize(imgs[0].size(), bitsPerExtMemWord) / bitsPerExtMemWord;
   const unsigned int psl = paddedSize(labelBits, bitsPerExtMemWord) / bitsPerExtMemWord;
   // allocate buffers for binarized input and output data
-  ExtMemWord * binImages = new ExtMemWord[(count * psi)];
+  DmaBuffer imagesMem = DmaBufferPoolInstance().acquire((count * psi)*sizeof(ExtMemWord));
+  ExtMemWord * binImages = imagesMem.as<ExtMemWord>();
 
   // binarize each image and label
   for(unsigned int i = 0; i < count; i++) {
@@ -120,7 +265,8 @@ std::vector<unsigned int> testPrebinarized_nolabel(std::vector<vec_t> & imgs, co
 
   // recognize
   unsigned int ok = 0, failed = 0;
-  ExtMemWord * outLabel = new ExtMemWord[(count * psl)];
+  DmaBuffer outMem = DmaBufferPoolInstance().acquire((count * psl)*sizeof(ExtMemWord));
+  ExtMemWord * outLabel = outMem.as<ExtMemWord>();
   TRANSFER_EXCL(thePlatform->copyBufferHostToAccel((void *)binImages, accelBufIn, sizeof(ExtMemWord)*count*psi));
   auto t1 = chrono::high_resolution_clock::now();
     FoldedMVOffloadBinarized(binImages, outLabel, count*psi, count*psl, count);
@@ -152,8 +298,6 @@ std::vector<unsigned int> testPrebinarized_nolabel(std::vector<vec_t> & imgs, co
 	  else
 		  result.push_back(1);
   }
-  delete [] outLabel;
-  delete [] binImages;
   return(result);
 }
 
@@ -168,7 +312,8 @@ std::vector<unsigned int> testPrebinarized_nolabel_multiple_images(std::vector<v
   const unsigned int psi = paddedSize(imgs[0].size(), bitsPerExtMemWord) / bitsPerExtMemWord;
   const unsigned int psl = paddedSize(labelBits, bitsPerExtMemWord) / bitsPerExtMemWord;
   // allocate buffers for binarized input and output data
-  ExtMemWord * binImages = new ExtMemWord[(count * psi)];
+  DmaBuffer imagesMem = DmaBufferPoolInstance().acquire((count * psi)*sizeof(ExtMemWord));
+  ExtMemWord * binImages = imagesMem.as<ExtMemWord>();
 
   // binarize each image and label
   for(unsigned int i = 0; i < count; i++) {
@@ -178,7 +323,8 @@ std::vector<unsigned int> testPrebinarized_nolabel_multiple_images(std::vector<v
 
   // recognize
   unsigned int ok = 0, failed = 0;
-  ExtMemWord * outLabel = new ExtMemWord[(count * psl)];
+  DmaBuffer outMem = DmaBufferPoolInstance().acquire((count * psl)*sizeof(ExtMemWord));
+  ExtMemWord * outLabel = outMem.as<ExtMemWord>();
   TRANSFER_EXCL(thePlatform->copyBufferHostToAccel((void *)binImages, accelBufIn, sizeof(ExtMemWord)*count*psi));
   auto t1 = chrono::high_resolution_clock::now();
     FoldedMVOffloadBinarized(binImages, outLabel, count*psi, count*psl, count);
@@ -207,8 +353,6 @@ std::vector<unsigned int> testPrebinarized_nolabel_multiple_images(std::vector<v
       }
     result.push_back((unsigned int) internal_result);
   }
-  delete [] outLabel;
-  delete [] binImages;
   return(result);
 }
 
@@ -223,7 +367,8 @@ void testPrebinarized(std::vector<vec_t> & imgs, std::vector<label_t> & labels,
   const unsigned int psi = paddedSize(imgs[0].size(), bitsPerExtMemWord) / bitsPerExtMemWord;
   const unsigned int psl = paddedSize(labelBits, bitsPerExtMemWord) / bitsPerExtMemWord;
   // allocate buffers for binarized input and output data
-  ExtMemWord * binImages = new ExtMemWord[(count * psi)];
+  DmaBuffer imagesMem = DmaBufferPoolInstance().acquire((count * psi)*sizeof(ExtMemWord));
+  ExtMemWord * binImages = imagesMem.as<ExtMemWord>();
   ExtMemWord * binLabels = new ExtMemWord[(count * psl)];
   // binarize each image and label
   for(unsigned int i = 0; i < count; i++) {
@@ -236,7 +381,8 @@ void testPrebinarized(std::vector<vec_t> & imgs, std::vector<label_t> & labels,
   cin >> r;
   // recognize
   unsigned int ok = 0, failed = 0;
-  ExtMemWord * outLabel = new ExtMemWord[(count * psl)];
+  DmaBuffer outMem = DmaBufferPoolInstance().acquire((count * psl)*sizeof(ExtMemWord));
+  ExtMemWord * outLabel = outMem.as<ExtMemWord>();
   TRANSFER_EXCL(thePlatform->copyBufferHostToAccel((void *)binImages, accelBufIn, sizeof(ExtMemWord)*count*psi));
   auto t1 = chrono::high_resolution_clock::now();
   for(unsigned int y = 0; y < r; y++)
@@ -257,34 +403,71 @@ void testPrebinarized(std::vector<vec_t> & imgs, std::vector<label_t> & labels,
   float usecPerImage = (float)duration / (count*r);
   cout << "Inference took " << duration << " microseconds, " << usecPerImage << " usec per image" << endl;
   cout << "Classification rate: " << 1000000.0 / usecPerImage << " images per second" << endl;
-  delete [] outLabel;
-  delete [] binImages;
   delete [] binLabels;
 }
 
-void FoldedMVLoadLayerMem(std::string dir, unsigned int layerNo, unsigned int peCount, unsigned int linesWMem, unsigned int linesTMem)
+static void FoldedMVReadLayerMem(std::string dir, unsigned int layerNo, unsigned int peCount, unsigned int linesWMem, unsigned int linesTMem, const FoldedMVMemSink & sink)
 {
+  // a memory image is read in one piece and handed over in one call, a
+  // short file leaves the remaining words zero
+  std::vector<ExtMemWord> mem(max(linesWMem, linesTMem));
   for(unsigned int pe = 0; pe < peCount; pe++) {
     // load weights
     ifstream wf(dir + "/" + to_string(layerNo) + "-" + to_string(pe) + "-weights.bin", ios::binary | ios::in);
     if(!wf.is_open())
       throw "Could not open file";
-    for(unsigned int line = 0 ; line < linesWMem; line++) {
-      ExtMemWord e = 0;
-      wf.read((char *)&e, sizeof(ExtMemWord));
-      FoldedMVMemSet(layerNo*2, pe, line, e);
-    }
+    fill(mem.begin(), mem.end(), 0);
+    wf.read((char *)mem.data(), linesWMem * sizeof(ExtMemWord));
+    sink(layerNo*2, pe, mem.data(), linesWMem);
     wf.close();
     // load thresholds
     ifstream tf(dir + "/" + to_string(layerNo) + "-" + to_string(pe) + "-thres.bin", ios::binary | ios::in);
     if(!tf.is_open())
       throw "Could not open file";
-    for(unsigned int line = 0 ; line < linesTMem; line++) {
-      ExtMemWord e = 0;
-      tf.read((char *)&e, sizeof(ExtMemWord));
-      FoldedMVMemSet(layerNo*2 + 1, pe, line, e);
-    }
+    fill(mem.begin(), mem.end(), 0);
+    tf.read((char *)mem.data(), linesTMem * sizeof(ExtMemWord));
+    sink(layerNo*2 + 1, pe, mem.data(), linesTMem);
     tf.close();
   }
 }
 
+void FoldedMVLoadLayerMem(std::string dir, unsigned int layerNo, unsigned int peCount, unsigned int linesWMem, unsigned int linesTMem)
+{
+  FoldedMVReadLayerMem(dir, layerNo, peCount, linesWMem, linesTMem, FoldedMVMemSetBulk);
+}
+
+// same as above with the memory images taken from a mapped parameter pack,
+// which are handed over in place
+static void FoldedMVReadLayerMem(const ParamPack & pack, unsigned int layerNo, const FoldedMVMemSink & sink)
+{
+  const ParamPackLayer & l = pack.layer(layerNo);
+  for(unsigned int pe = 0; pe < l.pe; pe++) {
+    sink(layerNo*2, pe, (const ExtMemWord *)pack.weights(layerNo, pe), l.wmem);
+    sink(layerNo*2 + 1, pe, (const ExtMemWord *)pack.thresholds(layerNo, pe), l.tmem);
+  }
+}
+
+void FoldedMVReadParams(std::string dir, const NetworkTopology & topology, const FoldedMVMemSink & sink)
+{
+  const string packFile = dir + "/" + paramPackName;
+  if(access(packFile.c_str(), R_OK) == 0) {
+    ParamPack pack(packFile);
+    pack.check(topology);
+    for(unsigned int layer = 0; layer < topology.layers.size(); layer++)
+      FoldedMVReadLayerMem(pack, layer, sink);
+    return;
+  }
+  for(unsigned int layer = 0; layer < topology.layers.size(); layer++) {
+    const LayerTopology & l = topology.layers[layer];
+    FoldedMVReadLayerMem(dir, layer, l.pe, l.wmem, l.tmem, sink);
+  }
+}
+
+NetworkTopology FoldedMVLoadNetwork(std::string dir)
+{
+  NetworkTopology topology = loadTopology(dir);
+  FoldedMVSetTopology(topology);
+  FoldedMVReadParams(dir, topology, FoldedMVMemSetBulk);
+  return topology;
+}
+
@@ -42,10 +42,14 @@
 #pragma once
 #include <string>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include "../tiny_cnn/tiny_cnn.h"
 #include "../hls/ap_int.h"
 #include "kernelbnn.h"
 #include "sds_lib.h"
+#include "topology.h"
+#include "buffer-pool.h"
 
 
 using namespace std;
@@ -85,12 +89,73 @@ void FoldedMVOffloadBinarized(
                     const unsigned int numImages
                   );
 
+// as FoldedMVOffloadBinarized, but only starts the call (kernelbnn myasync);
+// calls complete in the order they were started and in/out have to stay
+// untouched until then
+void FoldedMVOffloadAsync(const ExtMemWord * in, ExtMemWord * out,
+                          const unsigned int inBufWords, const unsigned int outBufWords, const unsigned int numImages);
+// waits for the oldest FoldedMVOffloadAsync call not yet waited for, given
+// the same arguments as that call
+void FoldedMVOffloadWait(const ExtMemWord * in, ExtMemWord * out,
+                         const unsigned int inBufWords, const unsigned int outBufWords, const unsigned int numImages);
+// FoldedMVOffloadWait without blocking: true if the oldest call has finished
+// (it then counts as waited for), false if it is still running
+bool FoldedMVOffloadPoll();
+
 void FoldedMVInit(const char * attachName);
 
+// select the network the accelerator runs, must precede loading its memories
+void FoldedMVSetTopology(const NetworkTopology & topology);
+// the network selected last, the config.h CNV until FoldedMVSetTopology is
+// called. A snapshot that stays valid across later switches; on the software
+// backend it is replaced in the same atomic swap as the network kernelbnn() runs
+std::shared_ptr<const NetworkTopology> FoldedMVTopology();
+
 void FoldedMVDeinit();
 
 void FoldedMVMemSet(unsigned int targetLayer, unsigned int targetMem, unsigned int targetInd, ExtMemWord val);
 
+// writes words 0..numWords-1 of one weight/threshold memory from a single
+// buffer, e.g. a whole PE memory image of a parameter pack
+void FoldedMVMemSetBulk(unsigned int targetLayer, unsigned int targetMem, const ExtMemWord * vals, unsigned int numWords);
+
+// read dir/topology.txt, select that network and load all of its weights
+// and thresholds from dir, from dir/params.pack if there is one
+NetworkTopology FoldedMVLoadNetwork(std::string dir);
+
+// receives whole memory images, targetLayer and targetMem as for FoldedMVMemSet
+typedef std::function<void(unsigned int targetLayer, unsigned int targetMem, const ExtMemWord * vals, unsigned int numWords)> FoldedMVMemSink;
+
+// reads the memory images of a network shaped like topology from dir (or
+// dir/params.pack) and hands each one to sink; does not touch the
+// accelerator, so it may run on any thread
+void FoldedMVReadParams(std::string dir, const NetworkTopology & topology, const FoldedMVMemSink & sink);
+
+#ifdef SW_BACKEND
+class SwNetwork;
+#endif
+
+// a network held in host memory, complete and ready to be switched to
+struct FoldedMVModel {
+  NetworkTopology topology;
+#ifdef SW_BACKEND
+  // loaded and prepared, becomes the network run by kernelbnn()
+  std::shared_ptr<SwNetwork> net;
+#else
+  // memory images by [targetLayer][targetMem], the on-chip memories hold a
+  // single network so these are uploaded on activation
+  std::vector<std::vector<std::vector<ExtMemWord> > > mems;
+#endif
+};
+
+// loads dir (as FoldedMVLoadNetwork) into a model without selecting it, may
+// run in a background thread while the accelerator keeps classifying
+std::shared_ptr<FoldedMVModel> FoldedMVPrepareModel(std::string dir);
+// makes model the running network; on the software backend this only swaps
+// a pointer and takes effect with the next image. Call it between images,
+// from the thread that runs the inference.
+std::shared_ptr<const NetworkTopology> FoldedMVActivateModel(const std::shared_ptr<FoldedMVModel> & model);
+
 void FoldedMVLoadLayerMem(std::string dir, unsigned int peCount, unsigned int layerNo, unsigned int linesWMem, unsigned int linesTMem);
 
 void testPrebinarized(std::vector<tiny_cnn::vec_t> & imgs, std::vector<tiny_cnn::label_t> & labels, const unsigned int labelBits);
@@ -130,7 +195,9 @@ void quantiseAndPack(const tiny_cnn::vec_t & in, ExtMemWord * out, unsigned int
 
 //#include "bnn-library.h"
 
+// host buffers for one image of the active network, set up by FoldedMVInit
 extern ExtMemWord * bufIn, * bufOut;
+extern unsigned int bufInWords, bufOutWords;
 
 template<unsigned int inWidth, unsigned int SIMDWidth>
 void FixedFoldedMVOffload(const tiny_cnn::vec_t &in,
@@ -139,7 +206,7 @@ void FixedFoldedMVOffload(const tiny_cnn::vec_t &in,
                         tiny_cnn::OffloadConvParams * convParams)
 {
   // binarize input and pack into bit stream
-  quantiseAndPack<inWidth, SIMDWidth>(in, bufIn);
+  quantiseAndPack<inWidth, SIMDWidth>(in, bufIn, bufInWords);
 
   // call the accelerator in compute mode
   //kernelbnn((ap_uint<64> *)bufIn, (ap_uint<64> *)bufOut, false, 0, 0, 0, 0, 0,0,0);
@@ -162,20 +229,16 @@ void testPrebuiltCIFAR10(std::vector<tiny_cnn::vec_t> & imgs, std::vector<tiny_c
   const unsigned int psi = paddedSize(imgs[0].size()*inWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
   // # of ExtMemWords per output
   const unsigned int pso = paddedSize(numCategories*outWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
-  if(INPUT_BUF_ENTRIES < count*psi)
-    throw "Not enough space in accelBufIn";
-  if(OUTPUT_BUF_ENTRIES < count*pso)
-    throw "Not enough space in accelBufOut";
 
   // allocate host-side buffers for packed input and outputs
   //ExtMemWord * packedImages = new ExtMemWord[(img_num * psi)];
   //ExtMemWord * packedOut = new ExtMemWord[(img_num * 16)];
 
-  ExtMemWord * packedImages; 
-  ExtMemWord * packedOut;
-
-  packedImages = (ExtMemWord *)sds_alloc(img_num*psi*sizeof(ExtMemWord));
-  packedOut = (ExtMemWord *)sds_alloc(img_num*16*sizeof(ExtMemWord));
+  // pool buffers, handed back (and reused by the next call) on return
+  DmaBuffer imagesMem = DmaBufferPoolInstance().acquire(img_num*psi*sizeof(ExtMemWord));
+  DmaBuffer outMem = DmaBufferPoolInstance().acquire(img_num*16*sizeof(ExtMemWord));
+  ExtMemWord * packedImages = imagesMem.as<ExtMemWord>();
+  ExtMemWord * packedOut = outMem.as<ExtMemWord>();
   
   cout << "Jose psi size:" << psi <<  "pso size:" << pso << " memworkd size: " << sizeof(ExtMemWord) << endl;
  
@@ -217,7 +280,7 @@ void testPrebuiltCIFAR10(std::vector<tiny_cnn::vec_t> & imgs, std::vector<tiny_c
 
   auto t1 = chrono::high_resolution_clock::now();
 
-  //kernelbnn((ap_uint<64> *)packedImages, (ap_uint<64> *)packedOut, false, 0, 0, 0, 0, img_num,psi,16);
+  FoldedMVOffloadBinarized(packedImages, packedOut, img_num*psi, img_num*16, img_num);
 
 /*
   for (int i = 0; i < PIPELINE_DEPTH; i++) {
@@ -312,8 +375,6 @@ void testPrebuiltCIFAR10(std::vector<tiny_cnn::vec_t> & imgs, std::vector<tiny_c
   cout << "Inference took " << duration << " microseconds, " << usecPerImage << " usec per image" << endl;
   cout << "Classification rate: " << 1000000.0 / usecPerImage << " images per second" << endl;
   cout << " diff ok " << (float)diff_ok/(float)(3*ok) << " diff error " << (float)diff_err/(float)(3*failed) << endl; 
-  sds_free(packedImages);
-  sds_free(packedOut);
   //free(packedImages_all);
   //free(packedOut_all);
 }
@@ -329,15 +390,11 @@ std::vector<unsigned int>  testPrebuiltCIFAR10_from_image(std::vector<tiny_cnn::
   const unsigned int psi = paddedSize(imgs[0].size()*inWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
   // # of ExtMemWords per output
   const unsigned int pso = paddedSize(64*outWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
-  if(INPUT_BUF_ENTRIES < count*psi)
-    throw "Not enough space in accelBufIn";
-  if(OUTPUT_BUF_ENTRIES < count*pso)
-    throw "Not enough space in accelBufOut";
   // allocate host-side buffers for packed input and outputs
-  //ExtMemWord * packedImages = new ExtMemWord[(count * psi)];
-  ExtMemWord * packedImages = (ExtMemWord *)sds_alloc((count * psi)*sizeof(ExtMemWord));
-  //ExtMemWord * packedOut = new ExtMemWord[(count * pso)];
-  ExtMemWord * packedOut = (ExtMemWord *)sds_alloc((count * pso)*sizeof(ExtMemWord));
+  DmaBuffer imagesMem = DmaBufferPoolInstance().acquire((count * psi)*sizeof(ExtMemWord));
+  DmaBuffer outMem = DmaBufferPoolInstance().acquire((count * pso)*sizeof(ExtMemWord));
+  ExtMemWord * packedImages = imagesMem.as<ExtMemWord>();
+  ExtMemWord * packedOut = outMem.as<ExtMemWord>();
   
   tiny_cnn::chaninterleave_layer<tiny_cnn::activation::identity> interleaver(3, 32*32, false);
   // interleave and pack inputs
@@ -349,7 +406,7 @@ std::vector<unsigned int>  testPrebuiltCIFAR10_from_image(std::vector<tiny_cnn::
   // copy inputs to accelerator
   auto t1 = chrono::high_resolution_clock::now();
   // call the accelerator in compute mode
-  //kernelbnn((ap_uint<64> *)packedImages, (ap_uint<64> *)packedOut, false, 0, 0, 0, 0, count,psi,pso);
+  FoldedMVOffloadBinarized(packedImages, packedOut, count*psi, count*pso, count);
   auto t2 = chrono::high_resolution_clock::now();
   // compare against labels
   unsigned int ok = 0, failed = 0;
@@ -388,8 +445,6 @@ std::vector<unsigned int>  testPrebuiltCIFAR10_from_image(std::vector<tiny_cnn::
   usecPerImage = (float)duration / (count);
   cout << "Inference took " << duration << " microseconds, " << usecPerImage << " usec per image" << endl;
   cout << "Classification rate: " << 1000000.0 / usecPerImage << " images per second" << endl;
-  sds_free(packedImages);
-  sds_free(packedOut);
   return (result);
 }
 
@@ -402,13 +457,11 @@ std::vector<unsigned int> testPrebuiltCIFAR10_multiple_images(std::vector<tiny_c
   const unsigned int psi = paddedSize(imgs[0].size()*inWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
   // # of ExtMemWords per output
   const unsigned int pso = paddedSize(64*outWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
-  if(INPUT_BUF_ENTRIES < count*psi)
-    throw "Not enough space in accelBufIn";
-  if(OUTPUT_BUF_ENTRIES < count*pso)
-    throw "Not enough space in accelBufOut";
   // allocate host-side buffers for packed input and outputs
-  ExtMemWord * packedImages = new ExtMemWord[(count * psi)];
-  ExtMemWord * packedOut = new ExtMemWord[(count * pso)];
+  DmaBuffer imagesMem = DmaBufferPoolInstance().acquire((count * psi)*sizeof(ExtMemWord));
+  DmaBuffer outMem = DmaBufferPoolInstance().acquire((count * pso)*sizeof(ExtMemWord));
+  ExtMemWord * packedImages = imagesMem.as<ExtMemWord>();
+  ExtMemWord * packedOut = outMem.as<ExtMemWord>();
   
   tiny_cnn::chaninterleave_layer<tiny_cnn::activation::identity> interleaver(3, 32*32, false);
   // interleave and pack inputs
@@ -417,10 +470,13 @@ std::vector<unsigned int> testPrebuiltCIFAR10_multiple_images(std::vector<tiny_c
     quantiseAndPack<inWidth, 1>(interleaved, &packedImages[i * psi], psi);
   }
   cout << "Running prebuilt CIFAR-10 test for " << count << " images..." << endl;
-  // copy inputs to accelerator
+  // latency: the first image on its own, this also leaves the accelerator
+  // warmed up so the batch below measures steady state throughput
+  auto t0 = chrono::high_resolution_clock::now();
+  FoldedMVOffloadBinarized(packedImages, packedOut, psi, pso, 1);
   auto t1 = chrono::high_resolution_clock::now();
-  // call the accelerator in compute mode
-  //kernelbnn((ap_uint<64> *)packedImages, (ap_uint<64> *)packedOut, false, 0, 0, 0, 0, count,psi,pso);
+  // throughput: the whole batch in one submission
+  FoldedMVOffloadBinarized(packedImages, packedOut, count*psi, count*pso, count);
   auto t2 = chrono::high_resolution_clock::now();
   // compare against labels
 
@@ -439,11 +495,12 @@ std::vector<unsigned int> testPrebuiltCIFAR10_multiple_images(std::vector<tiny_c
     }
 	results.push_back(maxInd);
   }  
+  auto latency = chrono::duration_cast<chrono::microseconds>( t1 - t0 ).count();
   auto duration = chrono::duration_cast<chrono::microseconds>( t2 - t1 ).count();
+  // usecPerImage is the batch time amortised over the images, i.e. 1/throughput
   usecPerImage = (float)duration / (count);
+  cout << "Single image latency " << latency << " microseconds" << endl;
   cout << "Inference took " << duration << " microseconds, " << usecPerImage << " usec per image" << endl;
   cout << "Classification rate: " << 1000000.0 / usecPerImage << " images per second" << endl;
-  delete [] packedImages;
-  delete [] packedOut;
   return (results);
 }
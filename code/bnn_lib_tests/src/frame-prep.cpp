@@ -0,0 +1,257 @@
+/******************************************************************************
+ *
+ *
+ * @file frame-prep.cpp
+ *
+ * Frame preprocessing from box sums of the frame rows, see frame-prep.h.
+ *
+ *
+ *****************************************************************************/
+#include "frame-prep.h"
+#include <algorithm>
+
+using namespace std;
+
+// BT.601 (16..235 luma) YUV to RGB in 20-bit fixed point, the constants of
+// OpenCV's YUV to BGR conversions
+static const int yuvShift = 20;
+static const int yuvCY = 1220542;
+static const int yuvCUB = 2116026;
+static const int yuvCUG = -409993;
+static const int yuvCVG = -852492;
+static const int yuvCVR = 1673527;
+
+static inline uint8_t clamp8(int v) {
+  return (uint8_t)min(max(v, 0), 255);
+}
+
+// splits [start, start + len) into n boxes of whole pixels, box k is
+// [lo[k], hi[k])
+static void boxes(int start, int len, unsigned int n, vector<int> & lo, vector<int> & hi) {
+  lo.resize(n);
+  hi.resize(n);
+  for(unsigned int k = 0; k < n; k++) {
+    lo[k] = start + (int)((long long)k * len / n);
+    hi[k] = max(lo[k] + 1, start + (int)((long long)(k + 1) * len / n));
+  }
+}
+
+// the rounded average (2 sum + area) / (2 area) as a multiplication with
+// m = ceil(2^52 / (2 area)), exact while numerator * 2 area < 2^52, i.e.
+// for boxes up to 2M pixels (a whole 1080p frame). The box areas of an
+// output row take at most a few values, so m is only recomputed when the
+// area changes.
+class BoxAverage {
+public:
+  BoxAverage() : area(0), m(0) {}
+  unsigned int operator()(uint32_t sum, uint64_t a) {
+    if(a != area) {
+      area = a;
+      m = ((1ULL << 52) + 2 * a - 1) / (2 * a);
+    }
+    return (unsigned int)(((2ULL * sum + area) * m) >> 52);
+  }
+
+private:
+  uint64_t area, m;
+};
+
+// adds the sums of one row of C-channel (C <= 3) samples over the boxes
+// [lo[k], hi[k]) to acc[C*k + c]. Channel c of sample x is the byte at
+// p[x * Pitch + First + c * Step]; compile time layouts and one register per
+// running sum keep the loop free of loads but the samples (-O2 does not
+// unroll a loop over the channels).
+template<unsigned int C, unsigned int Pitch, unsigned int First, unsigned int Step>
+static inline void sumBoxes(const uint8_t * p, const int * lo, const int * hi, unsigned int n, uint32_t * acc) {
+  for(unsigned int k = 0; k < n; k++, acc += C) {
+    uint32_t r0 = 0, r1 = 0, r2 = 0;
+    const uint8_t * q = p + lo[k] * Pitch;
+    for(int x = lo[k]; x < hi[k]; x++, q += Pitch) {
+      r0 += q[First];
+      if(C > 1)
+        r1 += q[First + Step];
+      if(C > 2)
+        r2 += q[First + 2 * Step];
+    }
+    acc[0] += r0;
+    if(C > 1)
+      acc[1] += r1;
+    if(C > 2)
+      acc[2] += r2;
+  }
+}
+
+// COLOR_BGR2GRAY weights in 14-bit fixed point
+static inline uint8_t greyBgr(unsigned int b, unsigned int g, unsigned int r) {
+  return (uint8_t)((b * 1868 + g * 9617 + r * 4899 + (1 << 13)) >> 14);
+}
+
+static inline int lumaTerm(unsigned int y) {
+  return max((int)y - 16, 0) * yuvCY;
+}
+
+static inline uint8_t greyLuma(unsigned int y) {
+  return clamp8((lumaTerm(y) + (1 << (yuvShift - 1))) >> yuvShift);
+}
+
+// adds row r of the frame, BGR or luma, over the boxes to acc
+static inline void sumFrameRow(PixelFormat format, const uint8_t * row, const int * lo, const int * hi, unsigned int n, uint32_t * acc) {
+  if(format == PIXEL_BGR24)
+    sumBoxes<3, 3, 0, 1>(row, lo, hi, n, acc);
+  else if(format == PIXEL_YUYV)
+    sumBoxes<1, 2, 0, 0>(row, lo, hi, n, acc);
+  else
+    sumBoxes<1, 1, 0, 0>(row, lo, hi, n, acc);
+}
+
+void FramePrep::start(PixelFormat format, unsigned int width, unsigned int height) {
+  this->format = format;
+  this->width = width;
+  this->height = height;
+  thumb.clear();
+  if(width < thumbWidth || height < thumbHeight)
+    return;
+  // the boxes of a downscale partition the frame, so each row is added to
+  // one row of sums, written out once its last row is in
+  vector<int> cx0, cx1, cy0, cy1;
+  boxes(0, width, thumbWidth, cx0, cx1);
+  boxes(0, height, thumbHeight, cy0, cy1);
+  const unsigned int channels = format == PIXEL_BGR24 ? 3 : 1;
+  vector<uint32_t> acc(thumbWidth * channels, 0);
+  thumb.resize(thumbWidth * thumbHeight);
+  BoxAverage average;
+  unsigned int j = 0;
+  for(unsigned int y = 0; y < height; y++) {
+    sumFrameRow(format, data + y * stride, cx0.data(), cx1.data(), thumbWidth, acc.data());
+    if((int)y + 1 < cy1[j])
+      continue;
+    const uint64_t boxH = cy1[j] - cy0[j];
+    uint8_t * o = &thumb[j * thumbWidth];
+    for(unsigned int k = 0; k < thumbWidth; k++) {
+      const uint64_t area = boxH * (cx1[k] - cx0[k]);
+      if(channels == 3)
+        o[k] = greyBgr(average(acc[3 * k], area), average(acc[3 * k + 1], area), average(acc[3 * k + 2], area));
+      else
+        o[k] = greyLuma(average(acc[k], area));
+    }
+    fill(acc.begin(), acc.end(), 0);
+    j++;
+  }
+}
+
+void FramePrep::load(const uint8_t * bgr, unsigned int width, unsigned int height, size_t stride) {
+  if(width == 0 || height == 0)
+    throw "Empty frame";
+  data = bgr;
+  this->stride = stride;
+  chroma = nullptr;
+  chromaShiftY = 0;
+  start(PIXEL_BGR24, width, height);
+}
+
+void FramePrep::loadYuyv(const uint8_t * yuyv, unsigned int width, unsigned int height, size_t stride) {
+  if(width == 0 || height == 0 || width % 2 != 0)
+    throw "Empty frame or odd YUYV width";
+  // U V are in the luma rows
+  data = yuyv;
+  this->stride = stride;
+  chroma = yuyv;
+  chromaStride = stride;
+  chromaShiftY = 0;
+  start(PIXEL_YUYV, width, height);
+}
+
+void FramePrep::loadNv12(const uint8_t * y, size_t yStride, const uint8_t * uv, size_t uvStride, unsigned int width, unsigned int height) {
+  if(width == 0 || height == 0 || width % 2 != 0 || height % 2 != 0)
+    throw "Empty frame or odd NV12 size";
+  data = y;
+  stride = yStride;
+  chroma = uv;
+  chromaStride = uvStride;
+  chromaShiftY = 1;
+  start(PIXEL_NV12, width, height);
+}
+
+void FramePrep::resample(int x, int y, int w, int h, bool grey, uint8_t * out, unsigned int outW, unsigned int outH, size_t outStride) const {
+  if(width == 0)
+    throw "No frame loaded";
+  // clip to the frame
+  const int x0 = max(x, 0), y0 = max(y, 0);
+  const int x1 = min(x + w, (int)width), y1 = min(y + h, (int)height);
+  if(x1 <= x0 || y1 <= y0 || outW == 0 || outH == 0)
+    throw "Empty region";
+  if(grey && !thumb.empty() && x0 == 0 && y0 == 0 && x1 == (int)width && y1 == (int)height &&
+     outW == thumbWidth && outH == thumbHeight) {
+    for(unsigned int j = 0; j < outH; j++)
+      copy(&thumb[j * thumbWidth], &thumb[j * thumbWidth] + thumbWidth, out + j * outStride);
+    return;
+  }
+  vector<int> cx0, cx1, cy0, cy1;
+  boxes(x0, x1 - x0, outW, cx0, cx1);
+  boxes(y0, y1 - y0, outH, cy0, cy1);
+
+  const bool yuv = format != PIXEL_BGR24;
+  const unsigned int channels = yuv ? 1 : 3;
+  // the chroma samples covering each box, two pixels per sample
+  vector<int> ccx0(outW), ccx1(outW);
+  for(unsigned int k = 0; k < outW; k++) {
+    ccx0[k] = cx0[k] >> 1;
+    ccx1[k] = (cx1[k] + 1) >> 1;
+  }
+  vector<uint32_t> acc(outW * channels), chromaAcc(outW * 2);
+  BoxAverage average, chromaAverage;
+  for(unsigned int j = 0; j < outH; j++) {
+    // only the rows of the region are read
+    fill(acc.begin(), acc.end(), 0);
+    for(int r = cy0[j]; r < cy1[j]; r++)
+      sumFrameRow(format, data + r * stride, cx0.data(), cx1.data(), outW, acc.data());
+    const uint64_t boxH = cy1[j] - cy0[j];
+    const unsigned int ct = cy0[j] >> chromaShiftY, cb = (cy1[j] + (1 << chromaShiftY) - 1) >> chromaShiftY;
+    if(yuv && !grey) {
+      fill(chromaAcc.begin(), chromaAcc.end(), 0);
+      for(unsigned int r = ct; r < cb; r++) {
+        if(format == PIXEL_YUYV)
+          sumBoxes<2, 4, 1, 2>(chroma + r * chromaStride, ccx0.data(), ccx1.data(), outW, chromaAcc.data());
+        else
+          sumBoxes<2, 2, 0, 1>(chroma + r * chromaStride, ccx0.data(), ccx1.data(), outW, chromaAcc.data());
+      }
+    }
+    uint8_t * o = out + j * outStride;
+    for(unsigned int k = 0; k < outW; k++) {
+      const uint64_t area = boxH * (cx1[k] - cx0[k]);
+      const unsigned int v0 = average(acc[channels * k], area);
+      if(!yuv) {
+        const unsigned int v1 = average(acc[3 * k + 1], area);
+        const unsigned int v2 = average(acc[3 * k + 2], area);
+        if(grey) {
+          o[k] = greyBgr(v0, v1, v2);
+        } else {
+          o[3 * k] = v0;
+          o[3 * k + 1] = v1;
+          o[3 * k + 2] = v2;
+        }
+        continue;
+      }
+      if(grey) {
+        o[k] = greyLuma(v0);
+        continue;
+      }
+      const int luma = lumaTerm(v0);
+      const uint64_t chromaArea = (uint64_t)(cb - ct) * (ccx1[k] - ccx0[k]);
+      const int u = (int)chromaAverage(chromaAcc[2 * k], chromaArea) - 128;
+      const int vv = (int)chromaAverage(chromaAcc[2 * k + 1], chromaArea) - 128;
+      const int half = 1 << (yuvShift - 1);
+      o[3 * k] = clamp8((luma + half + yuvCUB * u) >> yuvShift);
+      o[3 * k + 1] = clamp8((luma + half + yuvCVG * vv + yuvCUG * u) >> yuvShift);
+      o[3 * k + 2] = clamp8((luma + half + yuvCVR * vv) >> yuvShift);
+    }
+  }
+}
+
+void FramePrep::resize(int x, int y, int w, int h, uint8_t * out, unsigned int outW, unsigned int outH, size_t outStride) const {
+  resample(x, y, w, h, false, out, outW, outH, outStride);
+}
+
+void FramePrep::resizeGrey(int x, int y, int w, int h, uint8_t * out, unsigned int outW, unsigned int outH, size_t outStride) const {
+  resample(x, y, w, h, true, out, outW, outH, outStride);
+}
@@ -0,0 +1,118 @@
+/******************************************************************************
+ *
+ *
+ * @file frame-prep.h
+ *
+ * Preprocessing of captured frames without whole-frame intermediates.
+ * load() streams the frame once and accumulates the ROI filter's 80x60
+ * grey thumbnail on the way, one row of box sums at a time. The 32x32
+ * network input of an ROI is then box filtered from the frame itself,
+ * reading only the rows the ROI covers, so the frame has to stay valid
+ * until the last resize(). Both are area-filtered (box) downscales: output
+ * pixels cover whole source pixels, box k of an n-wide output spans columns
+ * [k*w/n, (k+1)*w/n) of the region (at least one, when enlarging), and its
+ * average is scaled with fixed point reciprocals instead of a division.
+ *
+ * YUYV and NV12 frames, as delivered by USB cameras, are read as they are:
+ * luma and chroma are summed separately (chroma at its own resolution) and
+ * only the downscaled pixels are converted to BGR, with the BT.601 constants
+ * of OpenCV's YUV to BGR conversions. The grey thumbnail needs luma only.
+ *
+ *   FramePrep prep;
+ *   prep.load(frame);
+ *   prep.resizeGrey(thumbnail80x60);
+ *   ... roi from the thumbnail ...
+ *   prep.resize(roi, input32x32);
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+enum PixelFormat {
+  PIXEL_BGR24,                  // 3 bytes per pixel, as OpenCV's CV_8UC3
+  PIXEL_YUYV,                   // 4:2:2, Y0 U Y1 V for each pair of pixels
+  PIXEL_NV12                    // 4:2:0, a Y plane and a plane of interleaved U V
+};
+
+class FramePrep {
+public:
+  FramePrep() : format(PIXEL_BGR24), width(0), height(0), data(nullptr), stride(0), chroma(nullptr), chromaStride(0), chromaShiftY(0) {}
+
+  // reads the frame: width x height BGR pixels or YUYV pairs with rows stride
+  // bytes apart, or the planes of an NV12 frame. YUV frames need an even
+  // width (and height, for NV12). Only the pointers are kept, resize() reads
+  // the frame again.
+  void load(const uint8_t * bgr, unsigned int width, unsigned int height, size_t stride);
+  void loadYuyv(const uint8_t * yuyv, unsigned int width, unsigned int height, size_t stride);
+  void loadNv12(const uint8_t * y, size_t yStride, const uint8_t * uv, size_t uvStride, unsigned int width, unsigned int height);
+  // area-resamples the region (x, y, w, h) of the loaded frame, clipped to
+  // it, into outW x outH BGR (resize) or grey (resizeGrey) pixels at out,
+  // rows outStride bytes apart. The whole frame at thumbWidth x thumbHeight
+  // grey is the thumbnail accumulated by load().
+  void resize(int x, int y, int w, int h, uint8_t * out, unsigned int outW, unsigned int outH, size_t outStride) const;
+  void resizeGrey(int x, int y, int w, int h, uint8_t * out, unsigned int outW, unsigned int outH, size_t outStride) const;
+
+  // the same for 8-bit BGR images (cv::Mat), captured frames (Frame, see
+  // frame-source.h) and rectangles (cv::Rect); out has to be allocated at the
+  // output size, with 3 channels for resize() and 1 for resizeGrey()
+  template<typename Image>
+  void load(const Image & img) {
+    check(img, 3);
+    load(img.ptr(), img.cols, img.rows, img.step);
+  }
+  template<typename Frame>
+  void loadFrame(const Frame & f) {
+    if(f.format == PIXEL_YUYV)
+      loadYuyv(f.data, f.width, f.height, f.stride);
+    else if(f.format == PIXEL_NV12)
+      loadNv12(f.data, f.stride, f.chroma, f.chromaStride, f.width, f.height);
+    else
+      load(f.data, f.width, f.height, f.stride);
+  }
+  template<typename Rect, typename Image>
+  void resize(const Rect & r, Image & out) const {
+    check(out, 3);
+    resize(r.x, r.y, r.width, r.height, out.ptr(), out.cols, out.rows, out.step);
+  }
+  // the whole frame
+  template<typename Image>
+  void resize(Image & out) const {
+    check(out, 3);
+    resize(0, 0, width, height, out.ptr(), out.cols, out.rows, out.step);
+  }
+  template<typename Image>
+  void resizeGrey(Image & out) const {
+    check(out, 1);
+    resizeGrey(0, 0, width, height, out.ptr(), out.cols, out.rows, out.step);
+  }
+
+  static const unsigned int thumbWidth = 80, thumbHeight = 60;
+
+  unsigned int frameWidth() const { return width; }
+  unsigned int frameHeight() const { return height; }
+
+private:
+  template<typename Image>
+  static void check(const Image & img, int channels) {
+    if(img.channels() != channels || img.elemSize1() != 1)
+      throw "FramePrep image of the wrong type";
+  }
+  void start(PixelFormat format, unsigned int width, unsigned int height);
+  void resample(int x, int y, int w, int h, bool grey, uint8_t * out, unsigned int outW, unsigned int outH, size_t outStride) const;
+
+  PixelFormat format;
+  unsigned int width, height;
+  // the loaded frame: BGR pixels, YUYV pairs or the NV12 luma plane at data,
+  // the NV12 chroma plane at chroma
+  const uint8_t * data;
+  size_t stride;
+  const uint8_t * chroma;
+  size_t chromaStride;
+  // chroma rows are halved for NV12
+  unsigned int chromaShiftY;
+  // thumbWidth x thumbHeight grey pixels, empty for frames smaller than that
+  std::vector<uint8_t> thumb;
+};
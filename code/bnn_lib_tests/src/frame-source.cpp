@@ -0,0 +1,359 @@
+/******************************************************************************
+ *
+ *
+ * @file frame-source.cpp
+ *
+ * V4L2 and replay frame sources, see frame-source.h.
+ *
+ *
+ *****************************************************************************/
+#include "frame-source.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#endif
+
+using namespace std;
+
+cv::Mat Frame::mat() const {
+  cv::Mat m;
+  if(!data)
+    return m;
+  if(format == PIXEL_BGR24)
+    return cv::Mat(height, width, CV_8UC3, data, stride);
+  if(format == PIXEL_YUYV) {
+    cv::cvtColor(cv::Mat(height, width, CV_8UC2, data, stride), m, cv::COLOR_YUV2BGR_YUYV);
+  } else if(chroma == data + stride * height && chromaStride == stride) {
+    cv::cvtColor(cv::Mat(height * 3 / 2, width, CV_8UC1, data, stride), m, cv::COLOR_YUV2BGR_NV12);
+  } else {
+    // separate planes, make them contiguous first
+    cv::Mat nv12(height * 3 / 2, width, CV_8UC1);
+    cv::Mat(height, width, CV_8UC1, data, stride).copyTo(nv12.rowRange(0, height));
+    cv::Mat(height / 2, width, CV_8UC1, chroma, chromaStride).copyTo(nv12.rowRange(height, height * 3 / 2));
+    cv::cvtColor(nv12, m, cv::COLOR_YUV2BGR_NV12);
+  }
+  return m;
+}
+
+#ifdef __linux__
+static int xioctl(int fd, unsigned long request, void * arg) {
+  int r;
+  do {
+    r = ioctl(fd, request, arg);
+  } while(r == -1 && errno == EINTR);
+  return r;
+}
+
+// the open, streaming device with its mapped buffers; stays alive until the
+// source and all frames it handed out are gone
+class V4l2Device {
+public:
+  V4l2Device(const string & path, unsigned int width, unsigned int height, unsigned int buffers);
+  ~V4l2Device() { close(); }
+
+  // gives buffer index back to the driver
+  void requeue(unsigned int index);
+
+  int fd;
+  unsigned int width, height;
+  size_t stride;
+  PixelFormat format;
+  vector<void *> starts;
+  vector<size_t> lengths;
+  atomic<unsigned int> held;    // buffers dequeued and not yet returned
+
+private:
+  void close();
+};
+
+V4l2Device::V4l2Device(const string & path, unsigned int width, unsigned int height, unsigned int buffers)
+  : fd(-1), width(0), height(0), stride(0), format(PIXEL_BGR24), held(0) {
+  fd = open(path.c_str(), O_RDWR);
+  if(fd < 0)
+    throw "Could not open the camera";
+  try {
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if(xioctl(fd, VIDIOC_QUERYCAP, &cap) < 0)
+      throw "Not a V4L2 device";
+    const uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if(!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING))
+      throw "Camera does not support streaming capture";
+
+    // the camera's native YUV formats first, they are read without conversion
+    static const uint32_t preferred[] = {V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_BGR24};
+    static const PixelFormat formats[] = {PIXEL_YUYV, PIXEL_NV12, PIXEL_BGR24};
+    static const unsigned int bytesPerPixel[] = {2, 1, 3};
+    unsigned int choice = 3;
+    v4l2_fmtdesc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for(; xioctl(fd, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++)
+      for(unsigned int i = 0; i < choice; i++)
+        if(desc.pixelformat == preferred[i])
+          choice = i;
+    if(choice == 3)
+      throw "Camera delivers neither YUYV, NV12 nor BGR24 frames";
+
+    v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.pixelformat = preferred[choice];
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if(xioctl(fd, VIDIOC_S_FMT, &fmt) < 0)
+      throw "Could not set the capture format";
+    if(fmt.fmt.pix.pixelformat != preferred[choice])
+      throw "Camera did not accept its own pixel format";
+    format = formats[choice];
+    this->width = fmt.fmt.pix.width;
+    this->height = fmt.fmt.pix.height;
+    if(format != PIXEL_BGR24 && (this->width % 2 != 0 || (format == PIXEL_NV12 && this->height % 2 != 0)))
+      throw "Odd YUV frame size";
+    stride = max<size_t>(fmt.fmt.pix.bytesperline, (size_t)this->width * bytesPerPixel[choice]);
+
+    v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = buffers;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if(xioctl(fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2)
+      throw "Could not allocate capture buffers";
+    for(unsigned int i = 0; i < req.count; i++) {
+      v4l2_buffer b;
+      memset(&b, 0, sizeof(b));
+      b.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      b.memory = V4L2_MEMORY_MMAP;
+      b.index = i;
+      if(xioctl(fd, VIDIOC_QUERYBUF, &b) < 0)
+        throw "Could not query a capture buffer";
+      if(b.length < stride * this->height * (format == PIXEL_NV12 ? 3 : 2) / 2)
+        throw "Capture buffer too small";
+      void * p = mmap(nullptr, b.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, b.m.offset);
+      if(p == MAP_FAILED)
+        throw "Could not map a capture buffer";
+      starts.push_back(p);
+      lengths.push_back(b.length);
+      if(xioctl(fd, VIDIOC_QBUF, &b) < 0)
+        throw "Could not queue a capture buffer";
+    }
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if(xioctl(fd, VIDIOC_STREAMON, &type) < 0)
+      throw "Could not start capturing";
+  } catch(...) {
+    close();
+    throw;
+  }
+}
+
+void V4l2Device::close() {
+  if(fd < 0)
+    return;
+  v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  xioctl(fd, VIDIOC_STREAMOFF, &type);
+  for(unsigned int i = 0; i < starts.size(); i++)
+    munmap(starts[i], lengths[i]);
+  starts.clear();
+  ::close(fd);
+  fd = -1;
+}
+
+void V4l2Device::requeue(unsigned int index) {
+  v4l2_buffer b;
+  memset(&b, 0, sizeof(b));
+  b.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  b.memory = V4L2_MEMORY_MMAP;
+  b.index = index;
+  xioctl(fd, VIDIOC_QBUF, &b);
+  held--;
+}
+
+class V4l2Source : public FrameSource {
+public:
+  V4l2Source(const string & path, unsigned int width, unsigned int height, unsigned int buffers)
+    : dev(make_shared<V4l2Device>(path, width, height, buffers)), grabbed(0) {}
+
+  Frame grab() {
+    if(dev->held >= dev->starts.size())
+      throw "All capture buffers are in use";
+    v4l2_buffer b;
+    for(;;) {
+      memset(&b, 0, sizeof(b));
+      b.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      b.memory = V4L2_MEMORY_MMAP;
+      if(xioctl(dev->fd, VIDIOC_DQBUF, &b) < 0)
+        throw "Could not capture a frame";
+      dev->held++;
+      if(!(b.flags & V4L2_BUF_FLAG_ERROR))
+        break;
+      // corrupted frame, give it straight back
+      dev->requeue(b.index);
+    }
+    Frame f;
+    f.data = (uint8_t *)dev->starts[b.index];
+    f.width = dev->width;
+    f.height = dev->height;
+    f.stride = dev->stride;
+    f.format = dev->format;
+    if(f.format == PIXEL_NV12) {
+      // single planar NV12, the U V plane follows the Y plane
+      f.chroma = f.data + f.stride * f.height;
+      f.chromaStride = f.stride;
+    }
+    f.sequence = grabbed++;
+    shared_ptr<V4l2Device> d = dev;
+    const unsigned int index = b.index;
+    f.hold = shared_ptr<void>(f.data, [d, index](void *) { d->requeue(index); });
+    return f;
+  }
+
+  unsigned int buffers() const { return dev->starts.size(); }
+
+private:
+  shared_ptr<V4l2Device> dev;
+  unsigned long long grabbed;
+};
+#endif
+
+// replay buffers not held by any frame; shared with the frames' release
+struct ReplayBuffers {
+  vector<cv::Mat> slots;
+  vector<unsigned int> idle;
+  mutex lock;
+
+  void put(unsigned int i) {
+    lock_guard<mutex> g(lock);
+    idle.push_back(i);
+  }
+};
+
+// the files cv::imread() decodes, by extension; a dataset directory also
+// holds frames.store and score traces
+static bool isImageFile(const string & file) {
+  static const char * const extensions[] = {"png", "jpg", "jpeg", "bmp", "ppm", "pgm", "pbm", "tif", "tiff", "webp"};
+  const size_t dot = file.find_last_of("./");
+  if(dot == string::npos || file[dot] != '.')
+    return false;
+  string ext = file.substr(dot + 1);
+  for(char & c : ext)
+    c = tolower((unsigned char)c);
+  for(const char * e : extensions)
+    if(ext == e)
+      return true;
+  return false;
+}
+
+class ReplaySource : public FrameSource {
+public:
+  ReplaySource(const string & spec, unsigned int buffers) : bufs(make_shared<ReplayBuffers>()), next(0) {
+    struct stat st;
+    if(spec.find_first_of("*?") != string::npos) {
+      cv::glob(spec, files, false);
+    } else if(stat(spec.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      vector<cv::String> found;
+      cv::glob(spec + "/*", found, false);
+      for(const cv::String & f : found)
+        if(isImageFile(f))
+          files.push_back(f);
+    } else if(!video.open(spec)) {
+      throw "Could not open the replay source";
+    }
+    if(!video.isOpened() && files.empty())
+      throw "No frames to replay";
+    allocate(buffers);
+  }
+
+  // camera index through OpenCV's own V4L2 capture, which converts every
+  // frame to BGR; for cameras the mmap backend cannot stream
+  ReplaySource(int camera, unsigned int width, unsigned int height, unsigned int buffers) : bufs(make_shared<ReplayBuffers>()), next(0) {
+    if(!video.open(camera + CV_CAP_V4L2))
+      throw "Could not open the camera";
+    video.set(CV_CAP_PROP_FRAME_WIDTH, width);
+    video.set(CV_CAP_PROP_FRAME_HEIGHT, height);
+    allocate(buffers);
+  }
+
+  Frame grab() {
+    if(!video.isOpened() && next >= files.size())
+      return Frame();
+    unsigned int i;
+    {
+      lock_guard<mutex> g(bufs->lock);
+      if(bufs->idle.empty())
+        throw "All replay buffers are in use";
+      i = bufs->idle.back();
+      bufs->idle.pop_back();
+    }
+    // decode into the idle buffer; video frames of the same size reuse it
+    cv::Mat & slot = bufs->slots[i];
+    Frame f;
+    if(video.isOpened()) {
+      if(!video.read(slot) || slot.empty()) {
+        bufs->put(i);
+        return f;
+      }
+    } else {
+      f.name = files[next];
+      slot = cv::imread(files[next], cv::IMREAD_COLOR);
+      if(slot.empty()) {
+        bufs->put(i);
+        throw "Could not read a replayed frame";
+      }
+    }
+    f.data = slot.data;
+    f.width = slot.cols;
+    f.height = slot.rows;
+    f.stride = slot.step;
+    f.format = PIXEL_BGR24;
+    f.sequence = next++;
+    shared_ptr<ReplayBuffers> b = bufs;
+    f.hold = shared_ptr<void>(f.data, [b, i](void *) { b->put(i); });
+    return f;
+  }
+
+  unsigned int buffers() const { return bufs->slots.size(); }
+
+private:
+  void allocate(unsigned int buffers) {
+    bufs->slots.resize(max(buffers, 1u));
+    for(unsigned int i = bufs->slots.size(); i > 0; i--)
+      bufs->idle.push_back(i - 1);
+  }
+
+  shared_ptr<ReplayBuffers> bufs;
+  vector<cv::String> files;     // image files, or none when replaying a video
+  cv::VideoCapture video;
+  size_t next;                  // frames replayed so far
+};
+
+unique_ptr<FrameSource> openFrameSource(const string & spec, unsigned int width, unsigned int height, unsigned int buffers) {
+  if(spec.compare(0, 10, "/dev/video") == 0) {
+#ifdef __linux__
+    try {
+      return unique_ptr<FrameSource>(new V4l2Source(spec, width, height, buffers));
+    } catch(const char * e) {
+      cout << "V4L2 capture from " << spec << " failed (" << e << "), using OpenCV's capture" << endl;
+    }
+#endif
+    return unique_ptr<FrameSource>(new ReplaySource(atoi(spec.c_str() + 10), width, height, buffers));
+  }
+  return unique_ptr<FrameSource>(new ReplaySource(spec, buffers));
+}
+
+string defaultCaptureSource() {
+  const char * s = getenv("BNN_CAPTURE");
+  return s && *s ? s : "/dev/video0";
+}
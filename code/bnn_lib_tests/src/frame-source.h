@@ -0,0 +1,79 @@
+/******************************************************************************
+ *
+ *
+ * @file frame-source.h
+ *
+ * One capture path for the webcam driver and the dataset drivers. A
+ * FrameSource hands out frames that are views of a fixed set of buffers:
+ *
+ *   - the V4L2 backend ("/dev/videoN") dequeues the driver's mmap'd capture
+ *     buffers and returns them to the driver when the frame is released, so
+ *     frames are neither copied out of the driver nor converted: cameras
+ *     deliver YUYV or NV12, which FramePrep reads directly. Cameras it
+ *     cannot stream (other pixel formats only, no streaming I/O) fall back
+ *     to OpenCV's capture, which converts every frame to BGR;
+ *   - the replay backend (a glob pattern of image files, the image files of
+ *     a directory, or a video file) decodes into its own buffers, which
+ *     behave the same way, so the drivers run unchanged without a camera.
+ *
+ * Frames are reference counted; a buffer is reused once the last copy of its
+ * Frame is released or destroyed, even after the source itself is gone.
+ * Holding every buffer and grabbing again throws, as the source would stall.
+ *
+ *   std::unique_ptr<FrameSource> camera = openFrameSource("/dev/video0", 320, 240);
+ *   Frame f = camera->grab();
+ *   ... f.mat() ...
+ *   f.release();
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include "opencv2/opencv.hpp"
+#include "frame-prep.h"
+
+struct Frame {
+  Frame() : data(nullptr), width(0), height(0), stride(0), chroma(nullptr), chromaStride(0), format(PIXEL_BGR24), sequence(0) {}
+
+  uint8_t * data;               // first pixel (luma for NV12), writable until released
+  unsigned int width, height;
+  size_t stride;                // bytes from one row to the next
+  uint8_t * chroma;             // U V plane of NV12 frames
+  size_t chromaStride;
+  PixelFormat format;
+  unsigned long long sequence;  // frames grabbed from the source before this one
+  std::string name;             // file the frame was replayed from, empty for a camera
+
+  // empty frames mark the end of a replay
+  explicit operator bool() const { return data != nullptr; }
+  // view of BGR pixels, only valid while the frame is held; YUV frames are
+  // converted into a copy, meant for display only
+  cv::Mat mat() const;
+  // hands the buffer back to the source (when this is the last copy)
+  void release() { *this = Frame(); }
+
+  // keeps the buffer from being reused, owned by the source's backend
+  std::shared_ptr<void> hold;
+};
+
+class FrameSource {
+public:
+  virtual ~FrameSource() {}
+  // the next frame, or an empty frame when a replay is over; throws on a
+  // capture error or when all buffers are held
+  virtual Frame grab() = 0;
+  // number of buffers, i.e. of frames that can be held at once
+  virtual unsigned int buffers() const = 0;
+};
+
+// opens "/dev/video*" as a V4L2 camera capturing width x height frames (the
+// driver may pick the closest size it supports), through OpenCV if the mmap
+// backend fails, anything else as a replay at the files' own size. Throws if
+// the source cannot be opened.
+std::unique_ptr<FrameSource> openFrameSource(const std::string & spec, unsigned int width, unsigned int height, unsigned int buffers = 4);
+
+// capture source of the webcam driver: BNN_CAPTURE if set, else /dev/video0
+std::string defaultCaptureSource();
@@ -0,0 +1,316 @@
+/******************************************************************************
+ *
+ *
+ * @file frame-store.cpp
+ *
+ * Writer, memory mapped reader and streaming source of frame stores, see
+ * frame-store.h.
+ *
+ *
+ *****************************************************************************/
+#include "frame-store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const uint64_t frameAlign = 64;
+// images decoded at once while writing, in parallel
+static const unsigned int decodeChunk = 32;
+
+static uint64_t alignUp(uint64_t v) {
+  return (v + frameAlign - 1) / frameAlign * frameAlign;
+}
+
+static void padTo(ofstream & out, uint64_t & offset, uint64_t target) {
+  static const char zeros[frameAlign] = {0};
+  out.write(zeros, target - offset);
+  offset = target;
+}
+
+void writeFrameStore(const vector<string> & files, const string & storeFile) {
+  const string tmpFile = storeFile + ".tmp";
+  ofstream out(tmpFile, ios::binary | ios::out | ios::trunc);
+  if(!out.is_open())
+    throw "Could not create frame store";
+  FrameStoreHeader h;
+  memset(&h, 0, sizeof(h));
+  out.write((const char *)&h, sizeof(h));
+  uint64_t offset = sizeof(h);
+
+  vector<FrameStoreEntry> index(files.size());
+  vector<cv::Mat> decoded(decodeChunk);
+  for(size_t first = 0; first < files.size(); first += decodeChunk) {
+    const int n = (int)min<size_t>(decodeChunk, files.size() - first);
+    #pragma omp parallel for schedule(dynamic)
+    for(int i = 0; i < n; i++)
+      decoded[i] = cv::imread(files[first + i], cv::IMREAD_COLOR);
+    for(int i = 0; i < n; i++) {
+      const cv::Mat & m = decoded[i];
+      if(m.empty()) {
+        out.close();
+        unlink(tmpFile.c_str());
+        throw "Could not decode a frame for the frame store";
+      }
+      FrameStoreEntry & e = index[first + i];
+      struct stat st;
+      if(stat(files[first + i].c_str(), &st) != 0) {
+        out.close();
+        unlink(tmpFile.c_str());
+        throw "Could not stat a frame for the frame store";
+      }
+      e.srcSize = st.st_size;
+      e.srcMtime = st.st_mtime;
+      e.width = m.cols;
+      e.height = m.rows;
+      e.stride = m.cols * 3;
+      e.format = PIXEL_BGR24;
+      e.reserved = 0;
+      padTo(out, offset, alignUp(offset));
+      e.dataOffset = offset;
+      for(int r = 0; r < m.rows; r++)
+        out.write((const char *)m.ptr(r), e.stride);
+      offset += (uint64_t)e.stride * e.height;
+    }
+  }
+
+  padTo(out, offset, alignUp(offset));
+  h.indexOffset = offset;
+  uint64_t nameOffset = offset + index.size() * sizeof(FrameStoreEntry);
+  for(size_t i = 0; i < index.size(); i++) {
+    index[i].nameOffset = nameOffset;
+    index[i].nameLength = files[i].size();
+    nameOffset += files[i].size();
+  }
+  out.write((const char *)index.data(), index.size() * sizeof(FrameStoreEntry));
+  for(size_t i = 0; i < files.size(); i++)
+    out.write(files[i].data(), files[i].size());
+
+  memcpy(h.magic, frameStoreMagic, sizeof(h.magic));
+  h.version = frameStoreVersion;
+  h.numFrames = index.size();
+  h.size = nameOffset;
+  out.seekp(0);
+  out.write((const char *)&h, sizeof(h));
+  out.close();
+  if(!out || rename(tmpFile.c_str(), storeFile.c_str()) != 0) {
+    unlink(tmpFile.c_str());
+    throw "Could not write frame store";
+  }
+}
+
+FrameStore::FrameStore(const string & storeFile) : base(nullptr), size(0) {
+  int fd = open(storeFile.c_str(), O_RDONLY);
+  if(fd < 0)
+    throw "Could not open frame store";
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FrameStoreHeader)) {
+    close(fd);
+    throw "Frame store truncated";
+  }
+  size = st.st_size;
+  // private and writable: frames can be drawn on without touching the file
+  void * p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED)
+    throw "Could not map frame store";
+  base = (unsigned char *)p;
+
+  const char * error = nullptr;
+  FrameStoreHeader h;
+  memcpy(&h, base, sizeof(h));
+  if(memcmp(h.magic, frameStoreMagic, sizeof(h.magic)) != 0)
+    error = "Not a frame store";
+  else if(h.version != frameStoreVersion)
+    error = "Unsupported frame store version";
+  else if(h.size != size || h.indexOffset + (uint64_t)h.numFrames * sizeof(FrameStoreEntry) > size)
+    error = "Frame store truncated";
+  if(!error) {
+    index.resize(h.numFrames);
+    memcpy(index.data(), base + h.indexOffset, h.numFrames * sizeof(FrameStoreEntry));
+    for(unsigned int i = 0; i < index.size() && !error; i++) {
+      const FrameStoreEntry & e = index[i];
+      if(e.dataOffset + (uint64_t)e.stride * e.height > size || e.nameOffset + e.nameLength > size ||
+         e.format != PIXEL_BGR24 || e.stride < (uint64_t)e.width * 3)
+        error = "Frame store index out of range";
+    }
+  }
+  if(error) {
+    munmap(base, size);
+    throw error;
+  }
+}
+
+FrameStore::~FrameStore() {
+  munmap(base, size);
+}
+
+Frame FrameStore::frame(unsigned int i) const {
+  const FrameStoreEntry & e = index[i];
+  Frame f;
+  f.data = base + e.dataOffset;
+  f.width = e.width;
+  f.height = e.height;
+  f.stride = e.stride;
+  f.format = (PixelFormat)e.format;
+  f.sequence = i;
+  f.name.assign((const char *)base + e.nameOffset, e.nameLength);
+  f.hold = const_pointer_cast<FrameStore>(shared_from_this());
+  return f;
+}
+
+bool FrameStore::matches(const vector<string> & files) const {
+  if(files.size() != index.size())
+    return false;
+  for(size_t i = 0; i < files.size(); i++) {
+    const FrameStoreEntry & e = index[i];
+    struct stat st;
+    if(files[i].size() != e.nameLength || memcmp(files[i].data(), base + e.nameOffset, e.nameLength) != 0 ||
+       stat(files[i].c_str(), &st) != 0 || (uint64_t)st.st_size != e.srcSize || (int64_t)st.st_mtime != e.srcMtime)
+      return false;
+  }
+  return true;
+}
+
+void FrameStore::prefetch(unsigned int i) const {
+  const FrameStoreEntry & e = index[i];
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  const uintptr_t start = (uintptr_t)(base + e.dataOffset) & ~(page - 1);
+  const uintptr_t end = (uintptr_t)(base + e.dataOffset) + (uintptr_t)e.stride * e.height;
+  madvise((void *)start, end - start, MADV_WILLNEED);
+  // fault the pages in here rather than in the consumer
+  volatile unsigned char sink = 0;
+  for(uintptr_t a = start; a < end; a += page)
+    sink += *(const unsigned char *)a;
+  (void)sink;
+}
+
+uint64_t FrameStore::fingerprint() const {
+  uint64_t h = 14695981039346656037ULL;
+  for(size_t i = 0; i < index.size(); i++) {
+    const FrameStoreEntry & e = index[i];
+    const unsigned char * name = base + e.nameOffset;
+    for(uint32_t c = 0; c < e.nameLength; c++)
+      h = (h ^ name[c]) * 1099511628211ULL;
+    const uint64_t stamp[2] = {e.srcSize, (uint64_t)e.srcMtime};
+    const unsigned char * b = (const unsigned char *)stamp;
+    for(size_t c = 0; c < sizeof(stamp); c++)
+      h = (h ^ b[c]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+// streams a store in order; the prefetcher keeps up to ahead frames past the
+// last grabbed one paged in
+class FrameStoreSource : public FrameSource {
+public:
+  FrameStoreSource(shared_ptr<const FrameStore> store, unsigned int ahead)
+    : store(store), ahead(ahead), next(0), stop(false) {
+    if(ahead > 0)
+      prefetcher = thread(&FrameStoreSource::prefetch, this);
+  }
+
+  ~FrameStoreSource() {
+    {
+      lock_guard<mutex> g(lock);
+      stop = true;
+    }
+    wake.notify_one();
+    if(prefetcher.joinable())
+      prefetcher.join();
+  }
+
+  Frame grab() {
+    unsigned int i;
+    {
+      lock_guard<mutex> g(lock);
+      if(next >= store->frames())
+        return Frame();
+      i = next++;
+    }
+    wake.notify_one();
+    return store->frame(i);
+  }
+
+  // frames are views of the store, any number can be held
+  unsigned int buffers() const { return store->frames(); }
+
+private:
+  void prefetch() {
+    for(unsigned int done = 0; done < store->frames(); done++) {
+      unique_lock<mutex> g(lock);
+      wake.wait(g, [&] { return stop || done < next + ahead; });
+      if(stop)
+        return;
+      const bool grabbed = done < next;
+      g.unlock();
+      if(!grabbed)
+        store->prefetch(done);
+    }
+  }
+
+  shared_ptr<const FrameStore> store;
+  const unsigned int ahead;
+  unsigned int next;            // frames grabbed so far
+  bool stop;
+  mutex lock;
+  condition_variable wake;
+  thread prefetcher;
+};
+
+unique_ptr<FrameSource> FrameStore::stream(unsigned int ahead) const {
+  return unique_ptr<FrameSource>(new FrameStoreSource(shared_from_this(), ahead));
+}
+
+shared_ptr<FrameStore> openFrameStore(const string & pattern) {
+  vector<cv::String> found;
+  cv::glob(pattern, found, false);
+  if(found.empty())
+    throw "No frames to store";
+  const vector<string> files(found.begin(), found.end());
+  const size_t slash = files[0].find_last_of('/');
+  const string storeFile = (slash == string::npos ? string(".") : files[0].substr(0, slash)) + "/" + frameStoreName;
+
+  if(access(storeFile.c_str(), R_OK) == 0) {
+    try {
+      shared_ptr<FrameStore> store = make_shared<FrameStore>(storeFile);
+      if(store->matches(files))
+        return store;
+    } catch(const char *) {
+      // rebuilt below
+    }
+  }
+  cout << "Decoding " << files.size() << " frames into " << storeFile << endl;
+  try {
+    writeFrameStore(files, storeFile);
+    return make_shared<FrameStore>(storeFile);
+  } catch(const char * e) {
+    if(strcmp(e, "Could not create frame store") != 0 && strcmp(e, "Could not write frame store") != 0)
+      throw;
+  }
+  // read-only dataset: the store only lives as long as its mapping
+  char tmpFile[] = "/tmp/bnn-frames-XXXXXX";
+  int fd = mkstemp(tmpFile);
+  if(fd < 0)
+    throw "Could not create frame store";
+  close(fd);
+  try {
+    writeFrameStore(files, tmpFile);
+    shared_ptr<FrameStore> store = make_shared<FrameStore>(tmpFile);
+    unlink(tmpFile);
+    return store;
+  } catch(const char *) {
+    unlink(tmpFile);
+    throw;
+  }
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+ *
+ *
+ * @file frame-store.h
+ *
+ * Decoded frames of a dataset (a glob pattern of images, such as the PNGs of
+ * the experiments' DatasetN directories), stored raw in one file next to the
+ * images so that they are decoded once instead of once per experiment
+ * configuration.
+ *
+ * Layout (little endian), all frames 64-byte aligned:
+ *
+ *   FrameStoreHeader
+ *   frames                            BGR24 pixels, rows of width*3 bytes
+ *   FrameStoreEntry[numFrames]        index, at indexOffset
+ *   names                             the image paths, not terminated
+ *
+ * The entries remember the size and modification time of their image; a
+ * store that does not match the images any more is rebuilt. The store is
+ * mapped copy-on-write and frames are handed out in place.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "frame-source.h"
+
+const char frameStoreMagic[8] = {'B', 'N', 'N', 'F', 'R', 'A', 'M', 0};
+const uint32_t frameStoreVersion = 1;
+
+struct FrameStoreHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t numFrames;
+  uint64_t size;                // of the whole file
+  uint64_t indexOffset;
+};
+
+struct FrameStoreEntry {
+  uint64_t dataOffset;          // from the start of the file
+  uint64_t nameOffset;
+  uint64_t srcSize;             // of the image file
+  int64_t srcMtime;
+  uint32_t width, height, stride, format;
+  uint32_t nameLength, reserved;
+};
+
+// name of the store in the directory of the images
+const std::string frameStoreName = "frames.store";
+// frames paged in ahead of a stream by default
+const unsigned int frameStorePrefetch = 16;
+
+// decodes files (in this order) into a store at storeFile
+void writeFrameStore(const std::vector<std::string> & files, const std::string & storeFile);
+
+// a store mapped into memory, throws if the file is missing, truncated or of
+// another version
+class FrameStore : public std::enable_shared_from_this<FrameStore> {
+public:
+  explicit FrameStore(const std::string & storeFile);
+  ~FrameStore();
+
+  unsigned int frames() const { return index.size(); }
+  // frame i, in place; the frame keeps the store mapped
+  Frame frame(unsigned int i) const;
+  // true if the store holds exactly these files, unchanged since decoding
+  bool matches(const std::vector<std::string> & files) const;
+  // pages frame i in ahead of its use
+  void prefetch(unsigned int i) const;
+  // 64-bit FNV-1a of the images' paths, sizes and modification times, the
+  // same as long as the store matches the same images
+  uint64_t fingerprint() const;
+
+  // the frames in order, as a source like the replay of the images; a
+  // background thread pages in the next ahead frames while they are grabbed
+  // (none with ahead 0, for frames whose pixels are hardly read)
+  std::unique_ptr<FrameSource> stream(unsigned int ahead = frameStorePrefetch) const;
+
+private:
+  FrameStore(const FrameStore &);
+  FrameStore & operator=(const FrameStore &);
+
+  unsigned char * base;
+  size_t size;
+  std::vector<FrameStoreEntry> index;
+};
+
+// the store of the images matching pattern: the existing one if it is up to
+// date, else the images are decoded into a new one (in a temporary file if
+// their directory is not writable)
+std::shared_ptr<FrameStore> openFrameStore(const std::string & pattern);
@@ -0,0 +1,158 @@
+/******************************************************************************
+ *
+ *
+ * @file fxdconv-sw.cpp
+ *
+ * Fixed point first layer kernels of the software backend, see fxdconv-sw.h.
+ *
+ *
+ *****************************************************************************/
+#include "fxdconv-sw.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FXD_X86
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FXD_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+void fxdPackWeights(FxdWeights & fw, const signed char * signs, unsigned int neurons, unsigned int synapses) {
+  fw.neurons = neurons;
+  fw.paddedNeurons = (neurons + fxdNeuronAlign - 1) / fxdNeuronAlign * fxdNeuronAlign;
+  fw.quads = (synapses + 3) / 4;
+  fw.w.assign(fw.quads * fw.paddedNeurons * 4, 0);
+  fw.bias.assign(fw.paddedNeurons, 0);
+  for(unsigned int n = 0; n < neurons; n++) {
+    int sum = 0;
+    for(unsigned int i = 0; i < synapses; i++) {
+      fw.w[((i / 4) * fw.paddedNeurons + n) * 4 + i % 4] = signs[n * synapses + i];
+      sum += signs[n * synapses + i];
+    }
+    fw.bias[n] = -128 * sum;
+  }
+}
+
+static void fxdDotScalar(const FxdWeights & fw, const signed char * x, int32_t * acc, unsigned int n0, unsigned int n1) {
+  for(unsigned int n = n0; n < n1; n++) {
+    int32_t a = 0;
+    for(unsigned int q = 0; q < fw.quads; q++) {
+      const signed char * w = &fw.w[(q * fw.paddedNeurons + n) * 4];
+      a += w[0] * x[4 * q] + w[1] * x[4 * q + 1] + w[2] * x[4 * q + 2] + w[3] * x[4 * q + 3];
+    }
+    acc[n] = a;
+  }
+}
+
+#ifdef FXD_X86
+// pmaddubsw multiplies unsigned by signed bytes, so the pixels are offset by
+// 128 (flipping the sign bit) and the offset is removed again through bias.
+// Each 16-bit lane gains at most 2 * 255 per quad, so the partial sums are
+// widened to 32 bits every 64 quads.
+__attribute__((target("avx2")))
+static void fxdDotAvx2(const FxdWeights & fw, const signed char * x, int32_t * acc, unsigned int n0, unsigned int n1) {
+  const __m256i flip = _mm256_set1_epi8((char)0x80);
+  const __m256i ones = _mm256_set1_epi16(1);
+  for(unsigned int n = n0; n < n1; n += 8) {
+    __m256i acc32 = _mm256_load_si256((const __m256i *)&fw.bias[n]);
+    for(unsigned int q0 = 0; q0 < fw.quads; q0 += 64) {
+      const unsigned int qEnd = min(fw.quads, q0 + 64);
+      __m256i acc16 = _mm256_setzero_si256();
+      for(unsigned int q = q0; q < qEnd; q++) {
+        int32_t quad;
+        memcpy(&quad, &x[4 * q], 4);
+        __m256i xq = _mm256_xor_si256(_mm256_set1_epi32(quad), flip);
+        __m256i wq = _mm256_load_si256((const __m256i *)&fw.w[(q * fw.paddedNeurons + n) * 4]);
+        acc16 = _mm256_add_epi16(acc16, _mm256_maddubs_epi16(xq, wq));
+      }
+      acc32 = _mm256_add_epi32(acc32, _mm256_madd_epi16(acc16, ones));
+    }
+    _mm256_storeu_si256((__m256i *)&acc[n], acc32);
+  }
+}
+
+// vpdpbusd accumulates four unsigned x signed byte products straight into
+// 32 bits, 16 neurons per instruction
+__attribute__((target("avx512f,avx512vnni")))
+static void fxdDotAvx512Vnni(const FxdWeights & fw, const signed char * x, int32_t * acc, unsigned int n0, unsigned int n1) {
+  const __m512i flip = _mm512_set1_epi8((char)0x80);
+  for(unsigned int n = n0; n < n1; n += 16) {
+    __m512i a = _mm512_load_si512(&fw.bias[n]);
+    for(unsigned int q = 0; q < fw.quads; q++) {
+      int32_t quad;
+      memcpy(&quad, &x[4 * q], 4);
+      __m512i xq = _mm512_xor_si512(_mm512_set1_epi32(quad), flip);
+      a = _mm512_dpbusd_epi32(a, xq, _mm512_load_si512(&fw.w[(q * fw.paddedNeurons + n) * 4]));
+    }
+    _mm512_storeu_si512(&acc[n], a);
+  }
+}
+#endif
+
+#ifdef FXD_NEON
+#ifdef __ARM_FEATURE_DOTPROD
+// sdot takes signed bytes on both sides, no offset needed
+static void fxdDotNeon(const FxdWeights & fw, const signed char * x, int32_t * acc, unsigned int n0, unsigned int n1) {
+  for(unsigned int n = n0; n < n1; n += 4) {
+    int32x4_t a = vdupq_n_s32(0);
+    for(unsigned int q = 0; q < fw.quads; q++) {
+      int32_t quad;
+      memcpy(&quad, &x[4 * q], 4);
+      a = vdotq_s32(a, vld1q_s8(&fw.w[(q * fw.paddedNeurons + n) * 4]), vreinterpretq_s8_s32(vdupq_n_s32(quad)));
+    }
+    vst1q_s32(&acc[n], a);
+  }
+}
+#else
+// ARMv7 (Zynq Cortex-A9): vmull of two neurons' quads against the pixels,
+// pairwise accumulated into 32 bits, the two halves of each neuron are
+// added at the end
+static void fxdDotNeon(const FxdWeights & fw, const signed char * x, int32_t * acc, unsigned int n0, unsigned int n1) {
+  for(unsigned int n = n0; n < n1; n += 2) {
+    int32x4_t a = vdupq_n_s32(0);
+    for(unsigned int q = 0; q < fw.quads; q++) {
+      int32_t quad;
+      memcpy(&quad, &x[4 * q], 4);
+      int16x8_t p = vmull_s8(vld1_s8(&fw.w[(q * fw.paddedNeurons + n) * 4]), vreinterpret_s8_s32(vdup_n_s32(quad)));
+      a = vpadalq_s16(a, p);
+    }
+    vst1_s32(&acc[n], vpadd_s32(vget_low_s32(a), vget_high_s32(a)));
+  }
+}
+#endif
+#endif
+
+static fxd_dot_fn selectFxdDot() {
+#ifdef FXD_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512vnni"))
+    return fxdDotAvx512Vnni;
+  if(__builtin_cpu_supports("avx2"))
+    return fxdDotAvx2;
+#endif
+#ifdef FXD_NEON
+  return fxdDotNeon;
+#endif
+  return fxdDotScalar;
+}
+
+fxd_dot_fn fxdDotKernel() {
+  static const fxd_dot_fn fn = selectFxdDot();
+  return fn;
+}
+
+const char * fxdDotKernelName() {
+  fxd_dot_fn fn = fxdDotKernel();
+#ifdef FXD_X86
+  if(fn == fxdDotAvx512Vnni) return "avx512-vnni";
+  if(fn == fxdDotAvx2) return "avx2";
+#endif
+#ifdef FXD_NEON
+  if(fn == fxdDotNeon) return "neon";
+#endif
+  return "scalar";
+}
@@ -0,0 +1,46 @@
+/******************************************************************************
+ *
+ *
+ * @file fxdconv-sw.h
+ *
+ * Integer dot product kernels for the fixed point first layer of the
+ * software backend: signed 8-bit pixels times +1/-1 weights, for all
+ * neurons of the layer at once. Weights are interleaved four synapses per
+ * neuron, the granularity of pmaddubsw/vpdpbusd on x86 and of sdot on ARM.
+ * The widest variant the host supports is picked once at startup, with a
+ * portable scalar version as reference and fallback.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "../tiny_cnn/util/aligned_allocator.h"
+
+// neuron count granularity of the packed weights, the widest kernel
+// produces 16 accumulators per instruction
+const unsigned int fxdNeuronAlign = 16;
+
+struct FxdWeights {
+  unsigned int neurons;         // neurons actually in the layer
+  unsigned int paddedNeurons;   // neurons rounded up to fxdNeuronAlign
+  unsigned int quads;           // synapses per neuron in groups of four
+  // [quads][paddedNeurons][4] +1/-1 weights, padding is zero
+  std::vector<signed char, tiny_cnn::aligned_allocator<signed char, 64> > w;
+  // -128 * sum of each neuron's weights, undoes the offset that the x86
+  // kernels add to the pixels to make them unsigned
+  std::vector<int32_t, tiny_cnn::aligned_allocator<int32_t, 64> > bias;
+};
+
+// packs signs ([neurons][synapses], +1/-1) for the kernels
+void fxdPackWeights(FxdWeights & fw, const signed char * signs, unsigned int neurons, unsigned int synapses);
+
+// acc[n] = sum_i w[n][i] * x[i] for neurons n0 <= n < n1, both multiples of
+// fxdNeuronAlign and n1 <= paddedNeurons; x holds quads * 4 pixels with the
+// padding past the last synapse set to zero
+typedef void (*fxd_dot_fn)(const FxdWeights & fw, const signed char * x, int32_t * acc,
+                           unsigned int n0, unsigned int n1);
+
+// kernel chosen for this host, resolved on first use
+fxd_dot_fn fxdDotKernel();
+const char * fxdDotKernelName();
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *
+ *
+ * @file inference-queue.cpp
+ *
+ * Asynchronous inference over a ring of buffers, see inference-queue.h.
+ *
+ *
+ *****************************************************************************/
+#include "inference-queue.h"
+#include <string.h>
+
+using namespace std;
+
+InferenceQueue::InferenceQueue(unsigned int depth, unsigned int psi, unsigned int pso)
+  : psi(psi ? psi : FoldedMVTopology()->inWords()), pso(pso ? pso : FoldedMVTopology()->outWords()),
+    slots(max(depth, 1u)), issued(0), done(0) {
+  for(unsigned int i = 0; i < slots.size(); i++) {
+    slots[i].in = DmaBufferPoolInstance().acquire(this->psi * sizeof(ExtMemWord));
+    slots[i].out = DmaBufferPoolInstance().acquire(this->pso * sizeof(ExtMemWord));
+  }
+}
+
+InferenceQueue::~InferenceQueue() {
+  drain();
+}
+
+void InferenceQueue::retire() {
+  Slot & s = slot(done);
+  FoldedMVOffloadWait(s.in.as<ExtMemWord>(), s.out.as<ExtMemWord>(), psi, pso, 1);
+  done++;
+}
+
+ExtMemWord * InferenceQueue::next() {
+  if(issued - done == slots.size())
+    retire();
+  return slot(issued).in.as<ExtMemWord>();
+}
+
+InferenceQueue::Ticket InferenceQueue::submit() {
+  // makes sure the slot is free, in case next() was not called
+  next();
+  Slot & s = slot(issued);
+  FoldedMVOffloadAsync(s.in.as<ExtMemWord>(), s.out.as<ExtMemWord>(), psi, pso, 1);
+  return issued++;
+}
+
+InferenceQueue::Ticket InferenceQueue::submit(const ExtMemWord * packed) {
+  memcpy(next(), packed, psi * sizeof(ExtMemWord));
+  return submit();
+}
+
+bool InferenceQueue::poll(Ticket t) {
+  if(t >= issued)
+    throw "Ticket not submitted";
+  while(done <= t && FoldedMVOffloadPoll())
+    done++;
+  return done > t;
+}
+
+const ExtMemWord * InferenceQueue::wait(Ticket t) {
+  if(t >= issued)
+    throw "Ticket not submitted";
+  if(t + slots.size() < issued)
+    throw "Ticket output already overwritten";
+  while(done <= t)
+    retire();
+  return slot(t).out.as<ExtMemWord>();
+}
+
+void InferenceQueue::drain() {
+  while(done < issued)
+    retire();
+}
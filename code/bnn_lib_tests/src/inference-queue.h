@@ -0,0 +1,70 @@
+/******************************************************************************
+ *
+ *
+ * @file inference-queue.h
+ *
+ * Asynchronous single-image inference over a ring of input/output buffers.
+ * Each submit() starts one image through kernelbnn(myasync) and returns a
+ * ticket; while it runs the caller can capture and pack the next frame into
+ * the next buffer and submit that as well, up to depth images in flight.
+ * Images complete in submission order. Works with the board as well as with
+ * the software backend, where images only overlap with BNN_SW_PIPELINE set.
+ *
+ *   InferenceQueue q(2);
+ *   pack(frame0, q.next()); t0 = q.submit();
+ *   pack(frame1, q.next()); t1 = q.submit();
+ *   use(q.wait(t0)); ...
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <vector>
+#include "foldedmv-offload.h"
+
+class InferenceQueue {
+public:
+  typedef unsigned long long Ticket;
+
+  // depth buffers of psi input and pso output words, by default sized for
+  // the active network
+  explicit InferenceQueue(unsigned int depth = 2, unsigned int psi = 0, unsigned int pso = 0);
+  // waits for all images still in flight
+  ~InferenceQueue();
+
+  // input buffer (psi words) for the next submit(); if all buffers are in
+  // flight this first waits for the oldest image
+  ExtMemWord * next();
+  // starts classifying the image packed into next()
+  Ticket submit();
+  // copies psi words of packed into next() and submits them
+  Ticket submit(const ExtMemWord * packed);
+
+  // true once image t is classified, never blocks
+  bool poll(Ticket t);
+  // waits for image t and returns its pso output words, which stay valid
+  // until depth more images have been submitted
+  const ExtMemWord * wait(Ticket t);
+  // waits for all images in flight
+  void drain();
+
+  unsigned int depth() const { return slots.size(); }
+  unsigned int inWords() const { return psi; }
+  unsigned int outWords() const { return pso; }
+
+private:
+  InferenceQueue(const InferenceQueue &);
+  InferenceQueue & operator=(const InferenceQueue &);
+
+  struct Slot {
+    DmaBuffer in, out;
+  };
+
+  Slot & slot(Ticket t) { return slots[t % slots.size()]; }
+  // waits for the oldest image in flight
+  void retire();
+
+  unsigned int psi, pso;
+  std::vector<Slot> slots;
+  // tickets are handed out in order, [done, issued) are in flight
+  Ticket issued, done;
+};
@@ -0,0 +1,134 @@
+/******************************************************************************
+ *
+ *
+ * @file input-encoder.cpp
+ *
+ * Single pass pixel to fixed point input encoder, see input-encoder.h.
+ *
+ *
+ *****************************************************************************/
+#include "input-encoder.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ENC_X86
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define ENC_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+// maps n bytes of src through the 256-entry table lut into dst
+typedef void (*encode_fn)(const uint8_t * lut, const uint8_t * src, uint8_t * dst, unsigned int n);
+
+// Also the kernel for AVX2 and for ARMv7 NEON (the Zedboard), whose byte
+// shuffles only index 16 (32) table entries: a 256-entry lookup takes 16 (8)
+// shuffles per vector, no faster than the table walk.
+static void encodeScalar(const uint8_t * lut, const uint8_t * src, uint8_t * dst, unsigned int n) {
+  for(unsigned int i = 0; i < n; i++)
+    dst[i] = lut[src[i]];
+}
+
+#ifdef ENC_X86
+// vpermi2b looks up 64 bytes in a 128-entry table, the top bit of the pixel
+// picks one of two such lookups
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static void encodeAvx512Vbmi(const uint8_t * lut, const uint8_t * src, uint8_t * dst, unsigned int n) {
+  const __m512i t0 = _mm512_loadu_si512(lut), t1 = _mm512_loadu_si512(lut + 64);
+  const __m512i t2 = _mm512_loadu_si512(lut + 128), t3 = _mm512_loadu_si512(lut + 192);
+  for(unsigned int i = 0; i < n; i += 64) {
+    const __mmask64 m = n - i >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (n - i)) - 1;
+    const __m512i idx = _mm512_maskz_loadu_epi8(m, src + i);
+    const __m512i lo = _mm512_permutex2var_epi8(t0, idx, t1);
+    const __m512i hi = _mm512_permutex2var_epi8(t2, idx, t3);
+    _mm512_mask_storeu_epi8(dst + i, m, _mm512_mask_blend_epi8(_mm512_movepi8_mask(idx), lo, hi));
+  }
+}
+#endif
+
+#ifdef ENC_NEON
+// tbl covers 64 entries per lookup; tbx leaves lanes whose index is out of
+// range alone, so four of them with shifted indices cover the table
+static void encodeNeon(const uint8_t * lut, const uint8_t * src, uint8_t * dst, unsigned int n) {
+  uint8x16x4_t t[4];
+  for(unsigned int q = 0; q < 4; q++)
+    for(unsigned int j = 0; j < 4; j++)
+      t[q].val[j] = vld1q_u8(lut + 64 * q + 16 * j);
+  const uint8x16_t step = vdupq_n_u8(64);
+  unsigned int i = 0;
+  for(; i + 16 <= n; i += 16) {
+    uint8x16_t idx = vld1q_u8(src + i);
+    uint8x16_t r = vqtbl4q_u8(t[0], idx);
+    idx = vsubq_u8(idx, step);
+    r = vqtbx4q_u8(r, t[1], idx);
+    idx = vsubq_u8(idx, step);
+    r = vqtbx4q_u8(r, t[2], idx);
+    idx = vsubq_u8(idx, step);
+    r = vqtbx4q_u8(r, t[3], idx);
+    vst1q_u8(dst + i, r);
+  }
+  encodeScalar(lut, src + i, dst + i, n - i);
+}
+#endif
+
+static encode_fn selectEncodeKernel() {
+#ifdef ENC_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512vbmi"))
+    return encodeAvx512Vbmi;
+#endif
+#ifdef ENC_NEON
+  return encodeNeon;
+#endif
+  return encodeScalar;
+}
+
+static encode_fn encodeKernel() {
+  static const encode_fn fn = selectEncodeKernel();
+  return fn;
+}
+
+const char * inputEncoderKernelName() {
+  encode_fn fn = encodeKernel();
+#ifdef ENC_X86
+  if(fn == encodeAvx512Vbmi) return "avx512-vbmi";
+#endif
+#ifdef ENC_NEON
+  if(fn == encodeNeon) return "neon";
+#endif
+  return "scalar";
+}
+
+InputEncoder::InputEncoder(tiny_cnn::float_t scaleMin, tiny_cnn::float_t scaleMax) {
+  // every pixel value through the float path of the frame loops
+  tiny_cnn::vec_t ramp(256);
+  for(unsigned int i = 0; i < 256; i++) {
+    const unsigned char c = i;
+    ramp[i] = scaleMin + (scaleMax - scaleMin) * c / 255;
+  }
+  ExtMemWord codes[256 / sizeof(ExtMemWord)];
+  quantiseAndPack<8, 1>(ramp, codes, 256 / sizeof(ExtMemWord));
+  for(unsigned int i = 0; i < 256; i++)
+    lut[i] = (uint8_t)(codes[i / sizeof(ExtMemWord)] >> (8 * (i % sizeof(ExtMemWord))));
+}
+
+// quantiseAndPack() puts value i into bits 8*(i%8) of word i/8, which on the
+// little endian hosts (x86, ARM) is byte i of the buffer
+void InputEncoder::encode(const uint8_t * pixels, unsigned int rows, unsigned int rowBytes, size_t stride,
+                          ExtMemWord * out, unsigned int outWords) const {
+  const size_t bytes = (size_t)rows * rowBytes;
+  if(bytes > (size_t)outWords * sizeof(ExtMemWord))
+    throw "Not enough space in input buffer";
+  uint8_t * dst = (uint8_t *)out;
+  const encode_fn fn = encodeKernel();
+  if(stride == rowBytes) {
+    fn(lut, pixels, dst, bytes);
+  } else {
+    for(unsigned int r = 0; r < rows; r++)
+      fn(lut, pixels + r * stride, dst + (size_t)r * rowBytes, rowBytes);
+  }
+  memset(dst + bytes, 0, outWords * sizeof(ExtMemWord) - bytes);
+}
@@ -0,0 +1,49 @@
+/******************************************************************************
+ *
+ *
+ * @file input-encoder.h
+ *
+ * Packs 8-bit camera pixels straight into the 8-bit fixed point input of the
+ * first layer, in one pass over the frame. Equivalent to scaling each byte c
+ * to scaleMin + (scaleMax - scaleMin) * c / 255 and running
+ * quantiseAndPack<8, 1>() on the floats, which is how the 256-entry code
+ * table is built, so the output is bit-identical to that path. Pixels are
+ * taken in memory order: a BGR cv::Mat gives the pixel-interleaved
+ * (channels innermost) layout the accelerator expects, so the channel
+ * interleave is just the walk over the rows.
+ *
+ *   InputEncoder enc(-1.0, 1.0);
+ *   enc.encode(frame32x32, packedImages, psi);
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "foldedmv-offload.h"
+
+class InputEncoder {
+public:
+  InputEncoder(tiny_cnn::float_t scaleMin = -1.0, tiny_cnn::float_t scaleMax = 1.0);
+
+  // encodes rows rows of rowBytes pixel bytes each, stride bytes apart, into
+  // outWords words, zero padded like quantiseAndPack()
+  void encode(const uint8_t * pixels, unsigned int rows, unsigned int rowBytes, size_t stride,
+              ExtMemWord * out, unsigned int outWords) const;
+
+  // the same for an 8-bit image (cv::Mat or anything else with its rows,
+  // cols, channels(), step and ptr()), continuous or not
+  template<typename Image>
+  void encode(const Image & img, ExtMemWord * out, unsigned int outWords) const {
+    encode(img.ptr(), img.rows, img.cols * img.channels(), img.step, out, outWords);
+  }
+
+  // code of pixel value c
+  uint8_t code(uint8_t c) const { return lut[c]; }
+
+private:
+  alignas(64) uint8_t lut[256];
+};
+
+// name of the table lookup kernel in use, for logging
+const char * inputEncoderKernelName();
@@ -0,0 +1,584 @@
+/******************************************************************************
+ *
+ *
+ * @file kernelbnn-sw.cpp
+ *
+ * Software (CPU) backend for the BNN accelerator, see kernelbnn-sw.h.
+ * Replaces libkernelbnn.a when building with "make BACKEND=sw".
+ *
+ *
+ *****************************************************************************/
+#include "kernelbnn-sw.h"
+#include "pipeline-sw.h"
+#include "sds_lib.h"
+#include "sds_lib-sw.h"
+#include "../tiny_cnn/util/popcount.h"
+#include <string.h>
+#include <stdlib.h>
+#include <memory>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <omp.h>
+
+using namespace std;
+
+const unsigned int wordBits = bitsPerExtMemWord;
+
+static inline unsigned int wordsFor(unsigned int bits) {
+  return (bits + wordBits - 1) / wordBits;
+}
+
+unsigned int SwLayer::outWords() const {
+  if(type == LAYER_FC_NOACT)
+    return wordsFor(matrixH * 16);
+  return outDim() * outDim() * wordsFor(ofmCh);
+}
+
+SwNetwork::SwNetwork() {
+  // CNV topology, see config.h
+  configure(defaultTopology());
+}
+
+SwNetwork::SwNetwork(const NetworkTopology & t) {
+  configure(t);
+}
+
+void SwNetwork::configure(const NetworkTopology & t) {
+  topology = t;
+  perf = modelPerformance(t);
+  layers.clear();
+  for(unsigned int i = 0; i < t.layers.size(); i++)
+    addLayer(t.layers[i]);
+}
+
+void SwNetwork::addLayer(const LayerTopology & t) {
+  SwLayer l;
+  l.type = t.kind;
+  l.k = t.k;
+  l.ifmCh = t.ifmCh;
+  l.ifmDim = t.ifmDim;
+  l.ofmCh = t.ofmCh;
+  l.ofmDim = t.ofmDim;
+  l.pool = t.pool;
+  l.simd = t.simd;
+  l.pe = t.pe;
+  l.wmem = t.wmem;
+  l.tmem = t.tmem;
+  l.matrixW = l.k * l.k * l.ifmCh;
+  l.matrixH = l.ofmCh;
+  // the last layer is padded in MH but only has weight memory for the first
+  // (wmem / synapse fold) neuron folds, the remaining outputs stay zero
+  const unsigned int neuronFold = l.wmem / (l.matrixW / l.simd);
+  l.rows = min(l.matrixH, neuronFold * l.pe);
+  l.wordsPerPixel = (l.type == LAYER_FXDCONV) ? 0 : wordsFor(l.ifmCh);
+  l.wordsPerRow = (l.type == LAYER_FXDCONV) ? wordsFor(l.matrixW) : l.k * l.k * l.wordsPerPixel;
+  l.wmemRaw.assign(l.pe * l.wmem, 0);
+  l.tmemRaw.assign(l.pe * l.tmem, 0);
+  l.weights.assign(l.rows * l.wordsPerRow, 0);
+  if(l.type == LAYER_FXDCONV)
+    l.signs.assign(l.rows * l.matrixW, -1);
+  l.thresholds.assign(l.rows, 0);
+  l.dirty = true;
+  l.threads = 0;
+  layers.push_back(l);
+}
+
+void SwNetwork::setParallelism(unsigned int layer, unsigned int threads) {
+  if(layer >= layers.size())
+    throw "Target layer out of range";
+  layers[layer].threads = threads;
+}
+
+unsigned int SwNetwork::inWords() const {
+  return topology.inWords();
+}
+
+unsigned int SwNetwork::outWords() const {
+  return topology.outWords();
+}
+
+void SwNetwork::memSet(unsigned int targetLayer, unsigned int targetMem, unsigned int targetInd, ExtMemWord val) {
+  const unsigned int layerNo = targetLayer / 2;
+  if(layerNo >= layers.size())
+    throw "Target layer out of range";
+  SwLayer & l = layers[layerNo];
+  if(targetLayer % 2 == 0) {
+    if(targetMem >= l.pe || targetInd >= l.wmem)
+      throw "Weight memory index out of range";
+    l.wmemRaw[targetMem * l.wmem + targetInd] = val;
+  } else {
+    // no threshold memory on the last layer, the hardware ignores these too
+    if(l.type == LAYER_FC_NOACT)
+      return;
+    if(targetMem >= l.pe || targetInd >= l.tmem)
+      throw "Threshold memory index out of range";
+    l.tmemRaw[targetMem * l.tmem + targetInd] = val;
+  }
+  l.dirty = true;
+}
+
+void SwNetwork::memSetBulk(unsigned int targetLayer, unsigned int targetMem, const ExtMemWord * vals, unsigned int numWords) {
+  const unsigned int layerNo = targetLayer / 2;
+  if(layerNo >= layers.size())
+    throw "Target layer out of range";
+  SwLayer & l = layers[layerNo];
+  if(targetLayer % 2 == 0) {
+    if(targetMem >= l.pe || numWords > l.wmem)
+      throw "Weight memory index out of range";
+    memcpy(&l.wmemRaw[targetMem * l.wmem], vals, numWords * sizeof(ExtMemWord));
+  } else {
+    if(l.type == LAYER_FC_NOACT)
+      return;
+    if(targetMem >= l.pe || numWords > l.tmem)
+      throw "Threshold memory index out of range";
+    memcpy(&l.tmemRaw[targetMem * l.tmem], vals, numWords * sizeof(ExtMemWord));
+  }
+  l.dirty = true;
+}
+
+void SwNetwork::prepare() {
+  for(unsigned int i = 0; i < layers.size(); i++) {
+    if(layers[i].dirty) {
+      repack(layers[i]);
+      layers[i].dirty = false;
+    }
+  }
+}
+
+// neuron n lives in PE (n % pe) at neuron fold (n / pe), its synapses occupy
+// synapseFold consecutive SIMD-wide words of that PE's weight memory. Repack
+// them into one contiguous row whose bit layout matches the input windows
+// read by the compute functions below (pixel-major, channels within a pixel
+// padded to whole words).
+void SwNetwork::repack(SwLayer & l) {
+  const unsigned int synapseFold = l.matrixW / l.simd;
+  fill(l.weights.begin(), l.weights.end(), 0);
+  fill(l.signs.begin(), l.signs.end(), -1);
+  for(unsigned int n = 0; n < l.rows; n++) {
+    const unsigned int pe = n % l.pe, nf = n / l.pe;
+    ExtMemWord * row = &l.weights[n * l.wordsPerRow];
+    for(unsigned int sf = 0; sf < synapseFold; sf++) {
+      ExtMemWord w = l.wmemRaw[pe * l.wmem + nf * synapseFold + sf];
+      for(unsigned int s = 0; s < l.simd; s++) {
+        if(!((w >> s) & 1))
+          continue;
+        unsigned int syn = sf * l.simd + s;
+        unsigned int bit = syn;
+        if(l.type == LAYER_FXDCONV)
+          l.signs[n * l.matrixW + syn] = 1;
+        else
+          bit = (syn / l.ifmCh) * l.wordsPerPixel * wordBits + (syn % l.ifmCh);
+        row[bit / wordBits] |= (ExtMemWord)1 << (bit % wordBits);
+      }
+    }
+    if(l.type != LAYER_FC_NOACT && nf < l.tmem)
+      l.thresholds[n] = (long long)l.tmemRaw[pe * l.tmem + nf];
+  }
+  if(l.type == LAYER_FXDCONV)
+    fxdPackWeights(l.fxd, l.signs.data(), l.rows, l.matrixW);
+}
+
+// Each compute function below produces the neurons n0 <= n < n1 of a layer
+// into an output that has been cleared beforehand. Several threads may share
+// a pixel's output words, so every thread collects the bits of its neurons
+// for one word and ORs them in atomically.
+static inline void orBits(ExtMemWord * o, ExtMemWord bits) {
+  if(bits)
+    __atomic_fetch_or(o, bits, __ATOMIC_RELAXED);
+}
+
+// layer 0: 8-bit fixed point (ap_fixed<8,1>) pixels with binary weights,
+// weight bit 1 adds the pixel and 0 subtracts it. The accumulator has 7
+// fractional bits while the thresholds are stored as ap_fixed<24,16> (8
+// fractional bits), hence the shift before comparing. The dot products of
+// the neurons for one window come from the SIMD kernels of fxdconv-sw.h.
+static void fxdConvLayer(const SwLayer & l, const signed char * in, ExtMemWord * out, SwScratch & s,
+                         unsigned int n0, unsigned int n1) {
+  const unsigned int outPixWords = wordsFor(l.ofmCh);
+  const unsigned int rowLen = l.k * l.ifmCh;
+  const unsigned int poolShift = l.pool ? 1 : 0;
+  const unsigned int od = l.outDim();
+  const fxd_dot_fn dot = fxdDotKernel();
+  const unsigned int kernelEnd = min(l.fxd.paddedNeurons, (n1 + fxdNeuronAlign - 1) / fxdNeuronAlign * fxdNeuronAlign);
+  // the kernels read whole quads, the padding past matrixW stays zero
+  s.window.assign(l.fxd.quads * 4, 0);
+  s.acc.resize(l.fxd.paddedNeurons);
+  for(unsigned int oy = 0; oy < (od << poolShift); oy++) {
+    for(unsigned int ox = 0; ox < (od << poolShift); ox++) {
+      for(unsigned int ky = 0; ky < l.k; ky++)
+        memcpy(&s.window[ky * rowLen], &in[((oy + ky) * l.ifmDim + ox) * l.ifmCh], rowLen);
+      dot(l.fxd, s.window.data(), s.acc.data(), n0, kernelEnd);
+      ExtMemWord * o = &out[((oy >> poolShift) * od + (ox >> poolShift)) * outPixWords];
+      ExtMemWord bits = 0;
+      for(unsigned int n = n0; n < n1; n++) {
+        if(((long long)s.acc[n] << 1) > l.thresholds[n])
+          bits |= (ExtMemWord)1 << (n % wordBits);
+        if(n % wordBits == wordBits - 1 || n == n1 - 1) {
+          orBits(&o[n / wordBits], bits);
+          bits = 0;
+        }
+      }
+    }
+  }
+}
+
+// XNOR-popcount of an input row against a neuron's weight row; the
+// padding bits are zero in both so popcount(xnor) = matrixW - popcount(xor)
+static inline unsigned int xnorPopcount(const ExtMemWord * a, const ExtMemWord * b, unsigned int words, unsigned int bits) {
+  return bits - (unsigned int)tiny_cnn::xor_popcount((const uint64_t *)a, (const uint64_t *)b, words);
+}
+
+// mismatches of a k x k window against a neuron's weight row, popcounted
+// run by run straight out of the input feature map; the runs are only a few
+// words long, so the three runs of a 3x3 window are interleaved to keep
+// independent popcounts in flight
+static inline unsigned int windowMismatches(const ExtMemWord * window, size_t lineWords, const ExtMemWord * w,
+                                            unsigned int k, unsigned int runWords) {
+  unsigned int c0 = 0, c1 = 0, c2 = 0;
+  if(k == 3) {
+    for(unsigned int i = 0; i < runWords; i++) {
+      c0 += __builtin_popcountll(window[i] ^ w[i]);
+      c1 += __builtin_popcountll(window[lineWords + i] ^ w[runWords + i]);
+      c2 += __builtin_popcountll(window[2 * lineWords + i] ^ w[2 * runWords + i]);
+    }
+    return c0 + c1 + c2;
+  }
+  for(unsigned int ky = 0; ky < k; ky++, window += lineWords, w += runWords)
+    for(unsigned int i = 0; i < runWords; i++)
+      c0 += __builtin_popcountll(window[i] ^ w[i]);
+  return c0;
+}
+
+// binarized convolution (and fully connected as the 1x1 case), input and
+// output feature maps are stored pixel-major with wordsFor(channels) words
+// per pixel, channel c at bit c. Row ky of a window is then k neighbouring
+// pixels, one contiguous run of k * wordsPerPixel words, which is
+// popcounted in place against slice ky of the weight row; nothing is
+// copied per output pixel. A following 2x2 max pool is fused in: on
+// binarized values it is an OR over the window, so each thresholded bit is
+// ORed straight into its pooled pixel, and a neuron whose pooled bit is
+// already set needs no popcount for the rest of the window.
+static void binConvLayer(const SwLayer & l, const ExtMemWord * in, ExtMemWord * out,
+                         unsigned int n0, unsigned int n1) {
+  const unsigned int wpp = l.wordsPerPixel;
+  const unsigned int outPixWords = wordsFor(l.ofmCh);
+  const unsigned int poolShift = l.pool ? 1 : 0;
+  const unsigned int od = l.outDim();
+  const unsigned int runWords = l.k * wpp;
+  const size_t lineWords = (size_t)l.ifmDim * wpp;
+  for(unsigned int oy = 0; oy < (od << poolShift); oy++) {
+    for(unsigned int ox = 0; ox < (od << poolShift); ox++) {
+      // run 0 of the window, run ky follows lineWords further on
+      const ExtMemWord * window = &in[((size_t)oy * l.ifmDim + ox) * wpp];
+      ExtMemWord * o = &out[((oy >> poolShift) * od + (ox >> poolShift)) * outPixWords];
+      for(unsigned int w = n0 / wordBits; w * wordBits < n1; w++) {
+        // bits this thread's neurons already set for the pooled pixel
+        ExtMemWord done = __atomic_load_n(&o[w], __ATOMIC_RELAXED);
+        ExtMemWord bits = 0;
+        for(unsigned int n = max(n0, w * wordBits); n < min(n1, (w + 1) * wordBits); n++) {
+          const ExtMemWord bit = (ExtMemWord)1 << (n % wordBits);
+          if(done & bit)
+            continue;
+          const ExtMemWord * wr = &l.weights[n * l.wordsPerRow];
+          const unsigned int acc = l.matrixW - windowMismatches(window, lineWords, wr, l.k, runWords);
+          if((long long)acc > l.thresholds[n])
+            bits |= bit;
+        }
+        orBits(&o[w], bits);
+      }
+    }
+  }
+}
+
+// last layer: no activation, the popcounts are streamed out as 16-bit
+// values; n0 and n1 are multiples of 4 so that threads own whole words
+static void fcNoActLayer(const SwLayer & l, const ExtMemWord * in, ExtMemWord * out,
+                         unsigned int n0, unsigned int n1) {
+  for(unsigned int n = n0; n < n1; n++) {
+    ExtMemWord acc = xnorPopcount(in, &l.weights[n * l.wordsPerRow], l.wordsPerRow, l.matrixW);
+    out[n / 4] |= (acc & 0xffff) << (16 * (n % 4));
+  }
+}
+
+// a thread should have at least this many words of popcount (or quads of
+// 8-bit products) to make up for the barrier
+static const unsigned int minWorkPerThread = 16384;
+
+unsigned long long SwNetwork::work(unsigned int layer) const {
+  const SwLayer & l = layers[layer];
+  const unsigned long long rowWork = (l.type == LAYER_FXDCONV) ? l.fxd.quads : l.wordsPerRow;
+  return (unsigned long long)l.ofmDim * l.ofmDim * l.rows * rowWork;
+}
+
+unsigned int SwNetwork::ways(const SwLayer & l, unsigned int team) const {
+  unsigned int n = l.threads;
+  if(n == 0)
+    n = (unsigned int)min<unsigned long long>(team, work(&l - &layers[0]) / minWorkPerThread);
+  return max(1u, min(n, team));
+}
+
+// neurons are handed out in chunks that keep the SIMD kernels of the fixed
+// point layer whole and the 16-bit outputs of the last layer word aligned
+static void neuronRange(const SwLayer & l, unsigned int part, unsigned int ways, unsigned int & n0, unsigned int & n1) {
+  const unsigned int align = (l.type == LAYER_FXDCONV) ? fxdNeuronAlign : (l.type == LAYER_FC_NOACT) ? 4 : 8;
+  const unsigned int chunks = (l.rows + align - 1) / align;
+  n0 = min(l.rows, chunks * part / ways * align);
+  n1 = min(l.rows, chunks * (part + 1) / ways * align);
+}
+
+static inline void teamBarrier(unsigned int team) {
+  if(team > 1) {
+    #pragma omp barrier
+  }
+}
+
+// Runs layers first <= i < last for one image as member part of a team of
+// threads (a team of 1 being the plain sequential case). Layer i reads maps[i % 3] and
+// writes maps[(i + 1) % 3], so the map the following layer writes was last
+// read by the preceding one and can be cleared while layer i is computed,
+// leaving a single barrier per layer.
+void SwNetwork::run(const ExtMemWord * in, ExtMemWord * out, SwScratch & maps, SwScratch & s,
+                    unsigned int part, unsigned int team, unsigned int first, unsigned int last) const {
+  const signed char * pixels = nullptr;
+  // output of layer i, the last layer writes the result directly
+  auto dst = [&](unsigned int i) {
+    return layers[i].type == LAYER_FC_NOACT ? out : maps.maps[(i + 1) % 3].data();
+  };
+  if(layers[0].type == LAYER_FXDCONV) {
+    // byte i of the 8-bit input stream is pixel element i, which on the
+    // little-endian hosts we run on is simply the byte order in memory
+    pixels = (const signed char *)in;
+  } else if(first == 0 && part == 0) {
+    // binarized input is already in the layout of a feature map
+    memcpy(maps.maps[0].data(), in, inWords() * sizeof(ExtMemWord));
+  }
+  // later layers find their output cleared by the layer before them
+  if(first == 0 && part == 0)
+    memset(dst(0), 0, layers[0].outWords() * sizeof(ExtMemWord));
+
+  for(unsigned int i = first; i < last; i++) {
+    const SwLayer & l = layers[i];
+    teamBarrier(team);
+    if(part == 0 && i + 1 < layers.size())
+      memset(dst(i + 1), 0, layers[i + 1].outWords() * sizeof(ExtMemWord));
+    const unsigned int w = ways(l, team);
+    if(part >= w)
+      continue;
+    unsigned int n0, n1;
+    neuronRange(l, part, w, n0, n1);
+    switch(l.type) {
+    case LAYER_FXDCONV:
+      fxdConvLayer(l, pixels, dst(i), s, n0, n1);
+      break;
+    case LAYER_CONV:
+    case LAYER_FC:
+      binConvLayer(l, maps.maps[i % 3].data(), dst(i), n0, n1);
+      break;
+    case LAYER_FC_NOACT:
+      fcNoActLayer(l, maps.maps[i % 3].data(), dst(i), n0, n1);
+      break;
+    }
+  }
+}
+
+void SwNetwork::allocMaps(SwScratch & s) const {
+  unsigned int maxWords = inWords();
+  for(unsigned int i = 0; i < layers.size(); i++)
+    maxWords = max(maxWords, layers[i].outWords());
+  for(unsigned int i = 0; i < 3; i++)
+    s.maps[i].resize(maxWords);
+}
+
+void SwNetwork::runLayers(const ExtMemWord * in, ExtMemWord * out, SwScratch & maps, SwScratch & s,
+                          unsigned int first, unsigned int last) const {
+  run(in, out, maps, s, 0, 1, first, last);
+}
+
+void SwNetwork::infer(const ExtMemWord * in, ExtMemWord * out, SwScratch & s) const {
+  allocMaps(s);
+  run(in, out, s, s, 0, 1, 0, layers.size());
+}
+
+void SwNetwork::inferParallel(const ExtMemWord * in, ExtMemWord * out, vector<SwScratch> & scratch) const {
+  allocMaps(scratch[0]);
+  #pragma omp parallel num_threads(scratch.size())
+  {
+    const unsigned int team = omp_get_num_threads();
+    run(in, out, scratch[0], scratch[omp_get_thread_num()], omp_get_thread_num(), team, 0, layers.size());
+  }
+}
+
+// the active network, replaced as a whole when switching models so that a
+// network is never modified while it is in use
+static shared_ptr<SwNetwork> & activeNetwork() {
+  static shared_ptr<SwNetwork> net = make_shared<SwNetwork>();
+  return net;
+}
+
+// the layer pipeline of BNN_SW_PIPELINE mode, built on first use
+static unique_ptr<SwPipeline> pipeline;
+// for each async call not yet waited for, the images that have to be
+// classified for it to be complete
+static deque<unsigned long long> pendingCalls;
+
+// finishes the queued images and drops the pipeline
+static void resetPipeline() {
+  pipeline.reset();
+  pendingCalls.clear();
+}
+
+SwNetwork & SwNetworkInstance() {
+  return *atomic_load(&activeNetwork());
+}
+
+shared_ptr<SwNetwork> SwActiveNetwork() {
+  return atomic_load(&activeNetwork());
+}
+
+void SwActivateNetwork(const shared_ptr<SwNetwork> & net) {
+  // the stages belong to the old network
+  resetPipeline();
+  atomic_store(&activeNetwork(), net);
+}
+
+// SDS queue of the async kernelbnn() calls
+static const unsigned int asyncQueue = 1;
+
+int kernelbnnTryWait() {
+  if(pendingCalls.empty())
+    return sds_try_wait(asyncQueue);
+  if(!pipeline->tryWaitFor(pendingCalls.front()))
+    return 0;
+  pendingCalls.pop_front();
+  return 1;
+}
+
+void kernelbnnMemInit(unsigned int targetLayer, unsigned int targetMem, const ExtMemWord * vals, unsigned int numWords) {
+  resetPipeline();
+  sdsSwIdle();
+  SwNetworkInstance().memSetBulk(targetLayer, targetMem, vals, numWords);
+}
+
+// Number of pipeline stages from BNN_SW_PIPELINE, 0 (the default) when the
+// layers should run one after the other instead.
+static unsigned int pipelineStages() {
+  static const unsigned int stages = getenv("BNN_SW_PIPELINE") ? atoi(getenv("BNN_SW_PIPELINE")) : 0;
+  return stages;
+}
+
+// Emulated PL clock in MHz, 0 to run at full speed. Set from BNN_SW_CLOCK,
+// after that config_clock() changes it like on the board.
+static atomic<unsigned int> & emulatedClock() {
+  static atomic<unsigned int> mhz(getenv("BNN_SW_CLOCK") ? atoi(getenv("BNN_SW_CLOCK")) : 0);
+  return mhz;
+}
+
+void kernelbnnSetClock(unsigned int mhz) {
+  if(emulatedClock() > 0 && mhz > 0)
+    emulatedClock() = mhz;
+}
+
+// holds back the end of a call that started at start until the accelerator
+// would have classified numReps images, see perfmodel.h
+static void paceCall(const SwNetwork & net, chrono::steady_clock::time_point start, unsigned int numReps) {
+  const unsigned int mhz = emulatedClock();
+  if(mhz == 0)
+    return;
+  const double us = (double)net.perf.callCycles(numReps) / mhz;
+  this_thread::sleep_until(start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, micro>(us)));
+}
+
+// classifies numReps images on the calling thread
+static void classify(const SwNetwork & net, const ExtMemWord * inWords, ExtMemWord * outWords,
+                     unsigned int numReps, unsigned int psi, unsigned int pso) {
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  // one set per calling thread: the caller of kernelbnn() and the emulated
+  // accelerator thread never share buffers, whatever order they run in
+  // (the OpenMP workers below use the caller's set through this reference)
+  static thread_local vector<SwScratch> callerScratch;
+  vector<SwScratch> & scratch = callerScratch;
+  if(scratch.size() < (size_t)omp_get_max_threads())
+    scratch.resize(omp_get_max_threads());
+  if(numReps == 1 && scratch.size() > 1) {
+    // a single image (e.g. a live camera frame): split each layer's neurons
+    // across the threads to bring down the latency
+    net.inferParallel(inWords, outWords, scratch);
+  } else {
+    // the weights are shared read-only, each thread works through its share
+    // of the batch with its own scratch buffers
+    #pragma omp parallel for schedule(dynamic) if(numReps > 1)
+    for(unsigned int i = 0; i < numReps; i++)
+      net.infer(&inWords[i * psi], &outWords[i * pso], scratch[omp_get_thread_num()]);
+  }
+  paceCall(net, start, numReps);
+}
+
+// Same contract as the hardware function: doInit writes one word of weight or
+// threshold memory, otherwise numReps images of psi words are classified into
+// pso-word outputs. As on the board an async call (myasync) only starts the
+// computation, on the emulated accelerator thread of sds_lib-sw.h, and a
+// wait-only call (mywait) waits for the oldest async call still outstanding
+// (sds_wait order). A call with neither flag runs after the outstanding ones
+// and returns when done. With BNN_SW_PIPELINE set the images go through a
+// layer pipeline instead (see pipeline-sw.h), with the same async behaviour.
+// With BNN_SW_CLOCK set a classification takes as long as on the board at
+// the emulated clock (not in pipeline mode, which runs at full speed).
+int kernelbnn(
+ap_uint<64> * in, ap_uint<64> * out, bool doInit,
+unsigned int targetLayer, unsigned int targetMem,
+unsigned int targetInd, ap_uint<64> val, unsigned int numReps, unsigned int psi, unsigned int pso, unsigned int myasync, unsigned int mywait) {
+  // holds on to the network for the whole call
+  const shared_ptr<SwNetwork> active = atomic_load(&activeNetwork());
+  SwNetwork & net = *active;
+  if(doInit) {
+    // the stages read the weights, and a new network may need other stages
+    resetPipeline();
+    // so may images still running on the accelerator thread
+    sdsSwIdle();
+    net.memSet(targetLayer, targetMem, targetInd, (ExtMemWord)val.to_uint64());
+    return 0;
+  }
+  if(mywait && !myasync) {
+    if(!pendingCalls.empty()) {
+      pipeline->waitFor(pendingCalls.front());
+      pendingCalls.pop_front();
+    } else {
+      sds_wait(asyncQueue);
+    }
+    return 0;
+  }
+  // repacks only after memory writes, which waited for the accelerator thread
+  net.prepare();
+  if(psi == 0)
+    psi = net.inWords();
+  if(pso == 0)
+    pso = net.outWords();
+  if(psi < net.inWords() || pso < net.outWords())
+    throw "Buffer too small for network input/output";
+  const ExtMemWord * inWords = (const ExtMemWord *)in;
+  ExtMemWord * outWords = (ExtMemWord *)out;
+  if(pipelineStages() > 0) {
+    if(!pipeline)
+      pipeline.reset(new SwPipeline(net, pipelineStages()));
+    for(unsigned int i = 0; i < numReps; i++)
+      pipeline->submit(&inWords[i * psi], &outWords[i * pso]);
+    if(myasync)
+      pendingCalls.push_back(pipeline->submitted());
+    else
+      pipeline->drain();
+    return 0;
+  }
+  if(myasync) {
+    // the job keeps the network alive even if another one is activated
+    sdsSwSubmit(asyncQueue, [active, inWords, outWords, numReps, psi, pso] {
+      classify(*active, inWords, outWords, numReps, psi, pso);
+    });
+    return 0;
+  }
+  // a synchronous call must not overtake the async ones
+  sdsSwIdle();
+  classify(net, inWords, outWords, numReps, psi, pso);
+  return 0;
+}
@@ -0,0 +1,137 @@
+/******************************************************************************
+ *
+ *
+ * @file kernelbnn-sw.h
+ *
+ * Software (CPU) backend for the BNN accelerator. Implements the same
+ * kernelbnn() interface as libkernelbnn.a, executing the CNV topology of
+ * config.h (or any network loaded through FoldedMVSetTopology()) with packed
+ * XNOR-popcount arithmetic, so the host code can run without the Zedboard
+ * bitstream (build with "make BACKEND=sw").
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <vector>
+#include <memory>
+#include "foldedmv-offload.h"
+#include "topology.h"
+#include "perfmodel.h"
+#include "fxdconv-sw.h"
+
+struct SwLayer {
+  LayerKind type;
+  // geometry, fully connected layers are treated as 1x1 convolutions
+  unsigned int k, ifmCh, ifmDim, ofmCh, ofmDim;
+  bool pool;                    // followed by a 2x2 max pool
+  // folding factors, these define the layout of the weight/threshold memories
+  unsigned int simd, pe, wmem, tmem;
+  unsigned int matrixW;         // synapses per neuron (k*k*ifmCh)
+  unsigned int matrixH;         // neurons (ofmCh)
+  unsigned int rows;            // neurons actually backed by weight memory
+  unsigned int wordsPerPixel;   // ExtMemWords per input pixel
+  unsigned int wordsPerRow;     // ExtMemWords per packed weight row (k*k*wordsPerPixel)
+  // memories as written by kernelbnn(doInit=true), [pe][wmem] and [pe][tmem]
+  std::vector<ExtMemWord> wmemRaw;
+  std::vector<ExtMemWord> tmemRaw;
+  // weights repacked per neuron in window order (pixel-major), [rows][wordsPerRow]
+  std::vector<ExtMemWord> weights;
+  // fixed point layers only: the same weights as +1/-1, [rows][matrixW]
+  std::vector<signed char> signs;
+  // and interleaved for the integer dot product kernels
+  FxdWeights fxd;
+  std::vector<long long> thresholds;
+  bool dirty;                   // raw memories changed since the last repack
+  // threads sharing the neurons when a single image is classified, the
+  // software counterpart of PE; 0 derives it from the layer's work
+  unsigned int threads;
+
+  unsigned int outDim() const { return pool ? ofmDim / 2 : ofmDim; }
+  unsigned int outWords() const;
+};
+
+// per-thread working memory for one inference; maps are the feature maps,
+// used round robin so that the output of a layer can be cleared while the
+// layer before it is still being computed
+struct SwScratch {
+  std::vector<ExtMemWord> maps[3];
+  std::vector<signed char> window;
+  std::vector<int32_t> acc;
+};
+
+class SwNetwork {
+public:
+  SwNetwork();
+  explicit SwNetwork(const NetworkTopology & t);
+
+  // replace the layers by those of t, all memories start out cleared
+  void configure(const NetworkTopology & t);
+
+  // kernelbnn(doInit=true) equivalent, targetLayer is 2*layer (+1 for thresholds)
+  void memSet(unsigned int targetLayer, unsigned int targetMem, unsigned int targetInd, ExtMemWord val);
+  // the same for words 0 <= i < numWords of one memory in a single copy
+  void memSetBulk(unsigned int targetLayer, unsigned int targetMem, const ExtMemWord * vals, unsigned int numWords);
+  // repack any layer whose memories changed, must be called before infer()
+  void prepare();
+  // classify one image: in holds inWords() words of packed input (8-bit
+  // pixels or binarized values), out receives outWords() words of 16-bit
+  // class scores
+  void infer(const ExtMemWord * in, ExtMemWord * out, SwScratch & s) const;
+  // classify one image with the neurons of each layer split across the
+  // threads of an OpenMP team, with a barrier between layers. Used for
+  // single images, where batch parallelism does not help the latency.
+  // scratch needs an entry per thread, the feature maps live in scratch[0].
+  void inferParallel(const ExtMemWord * in, ExtMemWord * out, std::vector<SwScratch> & scratch) const;
+  // number of threads for layer i in inferParallel(), 0 to pick it from the
+  // layer's work
+  void setParallelism(unsigned int layer, unsigned int threads);
+  // runs layers first <= i < last of one image on the calling thread, for
+  // callers that split the network into pipeline stages. maps carries the
+  // feature maps from one call to the next and must have been set up with
+  // allocMaps(); in and out are only touched by the first and last layer.
+  void runLayers(const ExtMemWord * in, ExtMemWord * out, SwScratch & maps, SwScratch & s,
+                 unsigned int first, unsigned int last) const;
+  void allocMaps(SwScratch & s) const;
+  // estimated cost of layer i for one image, in popcount words
+  unsigned long long work(unsigned int layer) const;
+
+  unsigned int inWords() const;
+  unsigned int outWords() const;
+
+  std::vector<SwLayer> layers;
+  NetworkTopology topology;
+  // modelled timing of the topology on the accelerator
+  NetworkPerf perf;
+
+private:
+  void addLayer(const LayerTopology & t);
+  void run(const ExtMemWord * in, ExtMemWord * out, SwScratch & maps, SwScratch & s,
+           unsigned int part, unsigned int team, unsigned int first, unsigned int last) const;
+  unsigned int ways(const SwLayer & l, unsigned int team) const;
+  void repack(SwLayer & l);
+};
+
+// the network instance driven by kernelbnn()
+SwNetwork & SwNetworkInstance();
+// the same, held on to: stays valid when another network is activated
+std::shared_ptr<SwNetwork> SwActiveNetwork();
+// makes net the network driven by kernelbnn(), images queued in the layer
+// pipeline are finished on the previous one first. Has to be called from the
+// thread calling kernelbnn(), between images.
+void SwActivateNetwork(const std::shared_ptr<SwNetwork> & net);
+
+// software-only companion of kernelbnn(doInit=true): loads numWords words of
+// weight (targetLayer = 2*layer) or threshold (2*layer + 1) memory targetMem
+// at once, straight from the caller's buffer
+void kernelbnnMemInit(unsigned int targetLayer, unsigned int targetMem, const ExtMemWord * vals, unsigned int numWords);
+
+// software-only companion of kernelbnn(mywait=true) that does not block:
+// returns 1 and retires the oldest outstanding async call if it has
+// finished (or if there is none), 0 otherwise
+int kernelbnnTryWait();
+
+// software-only companion of config_clock(): the PL clock in MHz the
+// accelerator is emulated at. Only takes effect when BNN_SW_CLOCK is set;
+// then every classification takes (at least) as long as perfmodel.h
+// predicts for the board, starting at the BNN_SW_CLOCK clock.
+void kernelbnnSetClock(unsigned int mhz);
@@ -68,6 +68,17 @@
 #include <string.h>
 #include <chrono>
 #include "foldedmv-offload.h"
+#include "model-registry.h"
+#include "input-encoder.h"
+#include "frame-prep.h"
+#include "frame-source.h"
+#include "frame-store.h"
+#include "score-frame.h"
+#include "score-trace.h"
+#include "score-recorder.h"
+#ifdef SW_BACKEND
+#include "kernelbnn-sw.h"
+#endif
 #include <algorithm>
 #include "opencv2/opencv.hpp"
 #include <unistd.h>  		//for sleep
@@ -158,20 +169,11 @@ void makeNetwork(network<mse, adagrad> & nn) {
 
 extern "C" void load_parameters(const char* path)
 {
-	#include "config.h"
 	FoldedMVInit("cnv-pynq");
 	network<mse, adagrad> nn;
 	makeNetwork(nn);
 			cout << "Setting network weights and thresholds in accelerator..." << endl;
-			FoldedMVLoadLayerMem(path , 0, L0_PE, L0_WMEM, L0_TMEM);
-			FoldedMVLoadLayerMem(path , 1, L1_PE, L1_WMEM, L1_TMEM);
-			FoldedMVLoadLayerMem(path , 2, L2_PE, L2_WMEM, L2_TMEM);
-			FoldedMVLoadLayerMem(path , 3, L3_PE, L3_WMEM, L3_TMEM);
-			FoldedMVLoadLayerMem(path , 4, L4_PE, L4_WMEM, L4_TMEM);
-			FoldedMVLoadLayerMem(path , 5, L5_PE, L5_WMEM, L5_TMEM);
-			FoldedMVLoadLayerMem(path , 6, L6_PE, L6_WMEM, L6_TMEM);
-			FoldedMVLoadLayerMem(path , 7, L7_PE, L7_WMEM, L7_TMEM);
-			FoldedMVLoadLayerMem(path , 8, L8_PE, L8_WMEM, L8_TMEM);
+			FoldedMVLoadNetwork(path);
 }
 
 extern "C" unsigned int inference(const char* path, unsigned int results[64], int number_class, float *usecPerImage)
@@ -303,6 +305,12 @@ void config_clock(int fsettings){
 
 	@param fsettings: the desired frequency
 */
+#ifdef SW_BACKEND
+	//no PL to reconfigure when running on the software backend, only the
+	//emulated accelerator timing (BNN_SW_CLOCK) follows the clock
+	kernelbnnSetClock(fsettings);
+	return;
+#endif
 	cout << "Starting PL clock configuration: " << endl;
 	int memfd;
 	void *mapped_base, *mapped_dev_base;
@@ -373,24 +381,28 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 	const unsigned int count = 1;
 	float_t scale_min = -1.0;
 	float_t scale_max = 1.0;
+	InputEncoder encoder(scale_min, scale_max);	//packs the 32x32 BGR frames straight into the input buffer
+	FramePrep prep;	//thumbnail accumulated while streaming each frame, network input area-filtered from the ROI rows
+	const std::shared_ptr<const NetworkTopology> topology = FoldedMVTopology();	//the network loaded above, for the whole sweep
 	// # of ExtMemWords per input
-	const unsigned int psi = 384; //paddedSize(imgs.size()*inWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
+	const unsigned int psi = topology->inWords();
 	// # of ExtMemWords per output
-	const unsigned int pso = 16; //paddedSize(64*outWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
-	if(INPUT_BUF_ENTRIES < psi)
-	throw "Not enough space in accelBufIn";
-	if(OUTPUT_BUF_ENTRIES < pso)
-	throw "Not enough space in accelBufOut";
+	const unsigned int pso = topology->outWords();
 	// allocate host-side buffers for packed input and outputs
-	ExtMemWord * packedImages = (ExtMemWord *)sds_alloc((count * psi)*sizeof(ExtMemWord));
-	ExtMemWord * packedOut = (ExtMemWord *)sds_alloc((count * pso)*sizeof(ExtMemWord));
-
-	config_clock(20);
+	DmaBuffer imagesMem = DmaBufferPoolInstance().acquire((count * psi)*sizeof(ExtMemWord));
+	DmaBuffer outMem = DmaBufferPoolInstance().acquire((count * pso)*sizeof(ExtMemWord));
+	ExtMemWord * packedImages = imagesMem.as<ExtMemWord>();
+	ExtMemWord * packedOut = outMem.as<ExtMemWord>();
+	ScoreRecorder recorder(prep, encoder, packedImages, packedOut, psi, pso);	//records the score traces replayed below
+
+	int clk_frq = 20;
+	config_clock(clk_frq);
 	vector<int> dataset_list = {1,2,3,4,5};
 	vector <vector<int> > win_list = {{1,1}};
 	vector<string> un_list = {"en"};
 	std::string roi_config = "full-roi";
 	bool dynclk = false;
+	bool trace_config = true; //replay the bnn from a score trace instead of running it for every configuration
 
 	float expected_acc = 66;
 	float resultant_acc = 0;
@@ -406,14 +418,20 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 
 		int folder_num = dataset_list[i];
 
-		//loading dataset
-		vector<cv::String> fn;
+		//dataset frames, decoded once into a frame store and replayed from it for every configuration
 		string src_dir =  TEST_DIR + "Dataset" + to_string(folder_num) + "/*.png";
-		glob(src_dir, fn, false);
-		size_t count_fn = fn.size();
+		std::shared_ptr<FrameStore> store = openFrameStore(src_dir);
 
 		cout << "Dataset" << folder_num << endl;
 
+		//bnn scores and stage timings of every frame, recorded once and replayed for every configuration
+		//(full-roi only, any other roi depends on the frames the window filter drops)
+		std::shared_ptr<ScoreTrace> trace;
+		if (trace_config && roi_config == "full-roi"){
+			std::string trace_file = "./experiments/result/dataset" + std::to_string(folder_num) + "-" + roi_config + "-" + std::to_string(clk_frq) + "MHz.trace";
+			trace = recorder.open(trace_file, scoreTraceKey(store->fingerprint(), paramsFingerprint(BNN_PARAMS), roi_config, topology->classes, clk_frq), *store);
+		}
+
 		for (int j = 0; j < un_list.size(); j ++){
 			std::string uncertainty_config = un_list[j];
 
@@ -432,17 +450,20 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 
 				//Initialize variables
 				cv::Mat reduced_sized_frame(32, 32, CV_8UC3);
-				cv::Mat cur_frame, src, reduced_roi_frame;
-				unsigned int number_class = 10;
+				cv::Mat cur_frame, reduced_roi_frame(60, 80, CV_8UC1);
+				unsigned int number_class = topology->classes;
 				unsigned int output = 0;
-				vector<string> classes = {"airplane", "automobile", "bird", "cat", "deer", "dog", "frog", "horse", "ship", "truck"};
+				vector<string> classes(number_class);
+				for (unsigned int c = 0; c < number_class; c++){
+					classes[c] = c < topology->classNames.size() ? topology->classNames[c] : std::to_string(c);
+				}
 				unsigned int frame_num = 0;
-				tiny_cnn::vec_t outTest(number_class, 0);
-				std::vector<uint8_t> bgr;
 				std::vector<std::vector<float> > results_history; //for storing the classification result of previous frame
 				float identified = 0.0 , identified_adj = 0.0, total_time = 0.0, total_cap_time = 0.0, total_bnn = 0.0, total_win = 0.0, total_un = 0.0;
 
-				cur_frame = imread(fn[0]);
+				std::unique_ptr<FrameSource> dataset = store->stream(trace ? 0 : frameStorePrefetch);
+				Frame frame = dataset->grab();
+				cur_frame = frame.mat();
 				//Initialise Roi, Window and Uncertainty Filter
 				Roi_filter r_filter(frame_width,frame_height);
 				r_filter.init_enhanced_roi(cur_frame);
@@ -454,7 +475,7 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 				int ps_mode = 0;
 				int frames_dropped = 0;
 				unsigned int adjusted_output = 0;
-				cv::Mat display_frame = cur_frame.clone();
+				cv::Mat display_frame = cur_frame;
 				int pastclk = 100;
 				float acc_time = 0;
 				int processed_frames = 0;
@@ -462,11 +483,11 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 				string display_output = "";
 				Rect display_roi(Point(0,0), Point(frame_width, frame_height));
 				bool process_frame = true;
-				std::vector<float> class_result;
+				ScoreFrame scores;	//decoded output of the current frame
 				std::string correct = "";
 
 				//for (size_t d=0; d<20; d++){
-				for (size_t d=0; d<count_fn; d++){
+				for (; frame; frame = dataset->grab()){
 
 					Rect roi(Point(0,0), Point(frame_width, frame_height));
 					process_frame = !(w_filter.dropf()); //check whether the current frame will be processed
@@ -477,119 +498,114 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 					float wfilter_time = 0;
 					float en_time = 0;
 					float var_time = 0;
+					float recorded_time = 0; //stage timings replayed from the trace
 					vector<double> u(5, 0.0);
 
-					cur_frame = imread(fn[d]);
+					cur_frame = frame.mat();
 
 					auto t0 = chrono::high_resolution_clock::now(); //time statistics
 
-					//Pipeline Capture Frame and ROI code Block with OpenMP Lib
-					#pragma omp parallel sections
-					{
-						#pragma omp section
+					if (trace){
+						//replayed: the recorded stage timings, nothing captured or resized
+						const ScoreTraceReplay t = trace->replay(frame.sequence, process_frame);
+						cap_time = t.captureUs;
+						preprocessing_time = t.prepUs;
+						recorded_time = t.elapsedUs;
+					} else {
+						//Pipeline Capture Frame and ROI code Block with OpenMP Lib
+						#pragma omp parallel sections
 						{
-							//cap >> cur_frame;
-							waitKey(6);
-							display_frame = cur_frame.clone();
+							#pragma omp section
+							{
+								//cap >> cur_frame;
+								waitKey(6);
+								display_frame = cur_frame;	//never drawn on, no copy needed
+
+								auto t2 = chrono::high_resolution_clock::now();	//time statistics
+								cap_time = chrono::duration_cast<chrono::microseconds>( t2 - t0 ).count();
+							}
 
-							auto t2 = chrono::high_resolution_clock::now();	//time statistics
-							cap_time = chrono::duration_cast<chrono::microseconds>( t2 - t0 ).count();
-						}
+							#pragma omp section
+							{	
+								//ROI Functions
+								auto t3 = chrono::high_resolution_clock::now(); //time statistics
+								if (process_frame){
+									prep.loadFrame(frame);
 
-						#pragma omp section
-						{	
-							//ROI Functions
-							auto t3 = chrono::high_resolution_clock::now(); //time statistics
-							if (process_frame){
+									if (roi_config == "eff-roi"){
 
-								if (roi_config == "eff-roi"){
+										prep.resizeGrey(reduced_roi_frame);
+										if (ps_mode != 1){
+											r_filter.init_enhanced_roi(reduced_roi_frame);
+										}
 
-									cv::resize(cur_frame, reduced_roi_frame, cv::Size(80, 60), 0, 0, cv::INTER_CUBIC);
-									if (ps_mode != 1){
-										r_filter.init_enhanced_roi(reduced_roi_frame);
-									}
+										if (ps_mode == 0){
 
-									if (ps_mode == 0){
+											roi = r_filter.get_full_roi();
 
-										roi = r_filter.get_full_roi();
+										}else if (ps_mode == 1){
 
-									}else if (ps_mode == 1){
+											roi = r_filter.enhanced_roi(reduced_roi_frame);
 
-										roi = r_filter.enhanced_roi(reduced_roi_frame);
+										}else if (ps_mode == 2){
 
-									}else if (ps_mode == 2){
+											roi = r_filter.get_past_roi();
 
-										roi = r_filter.get_past_roi();
+										}else if (ps_mode == 3){
 
-									}else if (ps_mode == 3){
+											roi = r_filter.basic_roi(reduced_roi_frame);
 
-										roi = r_filter.basic_roi(reduced_roi_frame);
+										}else{
+											roi = r_filter.get_past_roi();
+										}
 
-									}else{
-										roi = r_filter.get_past_roi();
-									}
+										prep.resize(roi, reduced_sized_frame);
+										encoder.encode(reduced_sized_frame, packedImages, psi);
 
-									src = cur_frame(roi);
-									cv::resize(src, reduced_sized_frame, cv::Size(32, 32), 0, 0, cv::INTER_CUBIC );
-									flatten_mat(reduced_sized_frame, bgr);
-									vec_t img;
-									std::transform(bgr.begin(), bgr.end(), std::back_inserter(img),[=](unsigned char c) { return scale_min + (scale_max - scale_min) * c / 255; });
-									quantiseAndPack<8, 1>(img, &packedImages[0], psi);
+									} else if (roi_config == "opt-roi"){
 
-								} else if (roi_config == "opt-roi"){
+										prep.resizeGrey(reduced_roi_frame);
+										//cv::resize(cur_frame, reduced_roi_frame, cv::Size(320, 240), 0, 0, cv::INTER_CUBIC );
 
-									cv::resize(cur_frame, reduced_roi_frame, cv::Size(80, 60), 0, 0, cv::INTER_CUBIC );
-									//cv::resize(cur_frame, reduced_roi_frame, cv::Size(320, 240), 0, 0, cv::INTER_CUBIC );
+										if (frame_num < 2){
+											roi = r_filter.get_full_roi();
+											r_filter.init_enhanced_roi(reduced_roi_frame);
+										} else {
+											roi = r_filter.enhanced_roi(reduced_roi_frame);
+										}
 
-									if (frame_num < 2){
-										roi = r_filter.get_full_roi();
-										r_filter.init_enhanced_roi(reduced_roi_frame);
-									} else {
-										roi = r_filter.enhanced_roi(reduced_roi_frame);
-									}
+										prep.resize(roi, reduced_sized_frame);
+										encoder.encode(reduced_sized_frame, packedImages, psi);
 
-									src = cur_frame(roi);
-									cv::resize(src, reduced_sized_frame, cv::Size(32, 32), 0, 0, cv::INTER_CUBIC );
-									flatten_mat(reduced_sized_frame, bgr);
-									vec_t img;
-									std::transform(bgr.begin(), bgr.end(), std::back_inserter(img),[=](unsigned char c) { return scale_min + (scale_max - scale_min) * c / 255; });
-									quantiseAndPack<8, 1>(img, &packedImages[0], psi);
 
-
-								} else if (roi_config == "cont-roi") {
+									} else if (roi_config == "cont-roi") {
 									
-									cv::resize(cur_frame, reduced_roi_frame, cv::Size(80, 60), 0, 0, cv::INTER_CUBIC );
-									//cv::resize(cur_frame, reduced_roi_frame, cv::Size(320, 240), 0, 0, cv::INTER_CUBIC );
+										prep.resizeGrey(reduced_roi_frame);
+										//cv::resize(cur_frame, reduced_roi_frame, cv::Size(320, 240), 0, 0, cv::INTER_CUBIC );
 
-									if (frame_num < 2){
-										roi = r_filter.get_full_roi();
-									} else {
-										roi = r_filter.basic_roi(reduced_roi_frame);
-									}
+										if (frame_num < 2){
+											roi = r_filter.get_full_roi();
+										} else {
+											roi = r_filter.basic_roi(reduced_roi_frame);
+										}
 
-									src = cur_frame(roi);
-									cv::resize(src, reduced_sized_frame, cv::Size(32, 32), 0, 0, cv::INTER_CUBIC );
-									flatten_mat(reduced_sized_frame, bgr);
-									vec_t img;
-									std::transform(bgr.begin(), bgr.end(), std::back_inserter(img),[=](unsigned char c) { return scale_min + (scale_max - scale_min) * c / 255; });
-									quantiseAndPack<8, 1>(img, &packedImages[0], psi);
+										prep.resize(roi, reduced_sized_frame);
+										encoder.encode(reduced_sized_frame, packedImages, psi);
 
 
-								} else {
+									} else {
 
-									//use full frame all the time, no roi
-									cv::resize(cur_frame, reduced_sized_frame, cv::Size(32, 32), 0, 0, cv::INTER_CUBIC );
-									flatten_mat(reduced_sized_frame, bgr);
-									vec_t img;
-									std::transform(bgr.begin(), bgr.end(), std::back_inserter(img),[=](unsigned char c) { return scale_min + (scale_max - scale_min) * c / 255; });
-									quantiseAndPack<8, 1>(img, &packedImages[0], psi);
+										//use full frame all the time, no roi
+										prep.resize(reduced_sized_frame);
+										encoder.encode(reduced_sized_frame, packedImages, psi);
 
+									}
 								}
-							}
-							//if dropping frame, not going to resize roi and transform it to array
-							auto t4 = chrono::high_resolution_clock::now();	//time statistics
-							preprocessing_time = chrono::duration_cast<chrono::microseconds>( t4 - t3 ).count();
+								//if dropping frame, not going to resize roi and transform it to array
+								auto t4 = chrono::high_resolution_clock::now();	//time statistics
+								preprocessing_time = chrono::duration_cast<chrono::microseconds>( t4 - t3 ).count();
 
+							}
 						}
 					}
 					auto t5 = chrono::high_resolution_clock::now();	//time statistics
@@ -598,35 +614,30 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 					if (process_frame){
 						//[Hardware-Related Functions] Call the bnn
 						auto t66 = chrono::high_resolution_clock::now();	//time statistics
-						kernelbnn((ap_uint<64> *)packedImages, (ap_uint<64> *)packedOut, false, 0, 0, 0, 0, count,psi,pso,1,0);
-						if (frame_num != 1)
-						{
+						if (trace){
+							//recorded scores instead of running the bnn
+							trace->scores(frame.sequence, scores);
+						} else {
+							//wait every frame: packedOut is decoded and packedImages refilled right after
+							kernelbnn((ap_uint<64> *)packedImages, (ap_uint<64> *)packedOut, false, 0, 0, 0, 0, count,psi,pso,1,0);
 							kernelbnn((ap_uint<64> *)packedImages, (ap_uint<64> *)packedOut, false, 0, 0, 0, 0, count,psi,pso,0,1);
+							//Extract the output of BNN and classify result
+							scores.decode((const uint16_t *)packedOut, number_class);
 						}
-						//Extract the output of BNN and classify result
-						//std::vector<float> class_result;
-						class_result.clear();
-						copyFromLowPrecBuffer<unsigned short>(&packedOut[0], outTest);
-						for(unsigned int j = 0; j < number_class; j++) {			
-							class_result.push_back(outTest[j]);
-						}
-						output = distance(class_result.begin(),max_element(class_result.begin(), class_result.end()));
+						output = scores.argmax();
 
 						auto t6 = chrono::high_resolution_clock::now();	//time statistics
-						bnn_time = chrono::duration_cast<chrono::microseconds>( t6 - t66 ).count();
+						bnn_time = trace ? trace->times(frame.sequence).bnnUs : chrono::duration_cast<chrono::microseconds>( t6 - t66 ).count();
 
 						//Data post-processing:
 						//calculate uncertainty
 						auto t77 = chrono::high_resolution_clock::now();	//time statistics
-						u = u_filter.cal_uncertainty(class_result,uncertainty_config, output);
+						u = u_filter.cal_uncertainty(scores,uncertainty_config, output);
 						ps_mode = u[3];
 						auto t7 = chrono::high_resolution_clock::now();	//time statistics
 						uncertainty_time = chrono::duration_cast<chrono::microseconds>( t7 - t77 ).count();
 					} else {
-						class_result.clear();
-						for(unsigned int j = 0; j < number_class; j++) {			
-							class_result.push_back(0);
-						}
+						scores.clear(number_class);
 					}
 
 					auto t8 = chrono::high_resolution_clock::now();	//time statistics
@@ -639,14 +650,14 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 						processed_frames += 1;
 					}
 					//Window Filter
-					adjusted_output = w_filter.analysis(class_result,ps_mode, win_config, aa, bb, cc, dd, ee, ff, gg, hh, ii, jj); //if win_config is true, win_step and length are flexible, else they are fixed to 8 12
+					adjusted_output = w_filter.analysis(scores,ps_mode, win_config, aa, bb, cc, dd, ee, ff, gg, hh, ii, jj); //if win_config is true, win_step and length are flexible, else they are fixed to 8 12
 					auto t9 = chrono::high_resolution_clock::now();	//time statistics
 					wfilter_time = chrono::duration_cast<chrono::microseconds>( t9 - t8).count();
-					float overall_time = chrono::duration_cast<chrono::microseconds>( t9 - t0 ).count();
+					float overall_time = recorded_time + chrono::duration_cast<chrono::microseconds>( t9 - t0 ).count();
 
 					//std::cout << "adjusted output: " << adjusted_output << endl;
-					if (adjusted_output > 9){
-						adjusted_output = 9;
+					if (adjusted_output > number_class - 1){
+						adjusted_output = number_class - 1;
 					}
 
 					//---------------------------------------Below output result to users and stored them on CSV files---------------------------------------------------------------
@@ -655,7 +666,7 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 					// std::cout << "adjusted output: " << classes[adjusted_output] << endl;
 					// std::cout << "-------------------------------------------------"<< endl;
 					
-					std::string expected_class = fn[frame_num];
+					std::string expected_class = frame.name;
 					int first_idx = expected_class.find_last_of('_') + 1;
 					expected_class = expected_class.substr(first_idx, expected_class.length()-4);
 					expected_class.erase(expected_class.length()-4);
@@ -726,7 +737,7 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 
 					frame_num++;
 
-					char ESC = waitKey(1);	
+					char ESC = trace ? 0 : waitKey(1);	//no window to poll while replaying
 					if (ESC == 27) 
 					{
 						cout << "ESC key is pressed by user" << endl;
@@ -772,7 +783,7 @@ int classify_frames(int aa, int bb, int cc, int dd, int ee, int ff, int gg, int
 	//cap.release();
 	config_clock(20); //reset clock to 100MHz
     //[Hardware-Related Functions] Release memory
-    sds_free(packedImages);
-	sds_free(packedOut);
+    imagesMem.reset();
+	outMem.reset();
     return 1;
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+/******************************************************************************
+ *
+ *
+ * @file main-parampack.cpp
+ *
+ * Converts the per-PE weight and threshold files of a params/ directory
+ * into a single parameter pack (see parampack.h), which load_parameters()
+ * then picks up instead of the individual files.
+ *
+ *   ./ParamPack <params dir> [pack file, default <params dir>/params.pack]
+ *
+ *
+ *****************************************************************************/
+#include <iostream>
+#include "parampack.h"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+  if(argc < 2 || argc > 3) {
+    cerr << "Usage: " << argv[0] << " <params dir> [pack file]" << endl;
+    return 1;
+  }
+  const string dir = argv[1];
+  const string packFile = argc > 2 ? argv[2] : dir + "/" + paramPackName;
+  try {
+    NetworkTopology t = loadTopology(dir);
+    writeParamPack(dir, t, packFile);
+    // read it back, this verifies the checksum and index
+    ParamPack pack(packFile);
+    pack.check(t);
+    cout << "Wrote " << packFile << ": " << t.name << ", " << pack.layers() << " layers" << endl;
+  } catch(const char * e) {
+    cerr << "Error: " << e << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,33 @@
+/******************************************************************************
+ *
+ *
+ * @file main-perfmodel.cpp
+ *
+ * Prints the modelled per-layer cycles, bottleneck, frame rate and latency
+ * of a network on the accelerator at each PL clock (see perfmodel.h), the
+ * config.h CNV if no params directory is given.
+ *
+ *   ./PerfModel [params dir]
+ *
+ *
+ *****************************************************************************/
+#include <iostream>
+#include "perfmodel.h"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+  if(argc > 2) {
+    cerr << "Usage: " << argv[0] << " [params dir]" << endl;
+    return 1;
+  }
+  try {
+    NetworkTopology t = argc > 1 ? loadTopology(argv[1]) : defaultTopology();
+    printPerformance(cout, t, modelPerformance(t));
+  } catch(const char * e) {
+    cerr << "Error: " << e << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -64,6 +64,15 @@
 #include <string.h>
 #include <chrono>
 #include "foldedmv-offload.h"
+#include "model-registry.h"
+#include "inference-queue.h"
+#include "input-encoder.h"
+#include "frame-prep.h"
+#include "frame-source.h"
+#include "score-frame.h"
+#ifdef SW_BACKEND
+#include "kernelbnn-sw.h"
+#endif
 #include <algorithm>
 #include "opencv2/opencv.hpp"
 #include <unistd.h>  		//for sleep
@@ -123,24 +132,6 @@ inline void print_vector(std::vector<T> &vec)
 	std::cout << "}" <<endl;
 }
 
-template<typename T>
-void flatten_mat(cv::Mat &m, std::vector<T> &v)
-{
-	if(m.isContinuous()) 
-	{
-		//cout<< "data is continuous"<< endl;
-		v.assign(m.datastart, m.dataend);
-	} 
-	else 
-	{
-		cout<< "data is not continuous"<< endl;
-		for (int i = 0; i < m.rows; ++i) 
-		{
-			v.insert(v.end(), m.ptr<T>(i), m.ptr<T>(i)+m.cols);
-		}
-	}
-}
-
 void makeNetwork(network<mse, adagrad> & nn) {
 	nn
 	#ifdef OFFLOAD
@@ -153,20 +144,11 @@ void makeNetwork(network<mse, adagrad> & nn) {
 
 extern "C" void load_parameters(const char* path)
 {
-	#include "config.h"
 	FoldedMVInit("cnv-pynq");
 	network<mse, adagrad> nn;
 	makeNetwork(nn);
 			cout << "Setting network weights and thresholds in accelerator..." << endl;
-			FoldedMVLoadLayerMem(path , 0, L0_PE, L0_WMEM, L0_TMEM);
-			FoldedMVLoadLayerMem(path , 1, L1_PE, L1_WMEM, L1_TMEM);
-			FoldedMVLoadLayerMem(path , 2, L2_PE, L2_WMEM, L2_TMEM);
-			FoldedMVLoadLayerMem(path , 3, L3_PE, L3_WMEM, L3_TMEM);
-			FoldedMVLoadLayerMem(path , 4, L4_PE, L4_WMEM, L4_TMEM);
-			FoldedMVLoadLayerMem(path , 5, L5_PE, L5_WMEM, L5_TMEM);
-			FoldedMVLoadLayerMem(path , 6, L6_PE, L6_WMEM, L6_TMEM);
-			FoldedMVLoadLayerMem(path , 7, L7_PE, L7_WMEM, L7_TMEM);
-			FoldedMVLoadLayerMem(path , 8, L8_PE, L8_WMEM, L8_TMEM);
+			FoldedMVLoadNetwork(path);
 }
 
 extern "C" unsigned int inference(const char* path, unsigned int results[64], int number_class, float *usecPerImage)
@@ -297,6 +279,12 @@ void config_clock(int fsettings){
 
 	@param fsettings: the desired frequency
 */
+#ifdef SW_BACKEND
+	//no PL to reconfigure when running on the software backend, only the
+	//emulated accelerator timing (BNN_SW_CLOCK) follows the clock
+	kernelbnnSetClock(fsettings);
+	return;
+#endif
 	cout << "Starting PL clock configuration: " << endl;
 	int memfd;
 	void *mapped_base, *mapped_dev_base;
@@ -359,16 +347,15 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 */
     //Initialize variables
 	cv::Mat reduced_sized_frame(32, 32, CV_8UC3);
-	cv::Mat cur_frame, src, reduced_roi_frame;
+	cv::Mat cur_frame, reduced_roi_frame(60, 80, CV_8UC1);
 	float_t scale_min = -1.0;
 	float_t scale_max = 1.0;
-	unsigned int number_class = 10;
+	InputEncoder encoder(scale_min, scale_max);	//packs the 32x32 BGR frames straight into the input buffer
+	FramePrep prep;	//thumbnail accumulated while streaming each frame, network input area-filtered from the ROI rows
+	unsigned int number_class = 10;	//number_class and classes follow the running network, see the frame loop
 	unsigned int output = 0;
 	vector<string> classes = {"airplane", "automobile", "bird", "cat", "deer", "dog", "frog", "horse", "ship", "truck"};
     unsigned int frame_num = 0;
-	tiny_cnn::vec_t outTest(number_class, 0);
-	const unsigned int count = 1;
-	std::vector<uint8_t> bgr;
 	std::vector<std::vector<float> > results_history; //for storing the classification result of previous frame
 	float identified = 0.0 , identified_adj = 0.0, total_time = 0.0, total_cap_time = 0.0, total_bnn = 0.0, total_win = 0.0, total_un = 0.0;
 	vector<Mat> frames;
@@ -380,31 +367,39 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 	FoldedMVInit("cnv-pynq");
 	network<mse, adagrad> nn;
 	makeNetwork(nn);
+	//a second network named by BNN_NEXT_PARAMS is loaded in the background and switched to between two frames
+	if (getenv("BNN_NEXT_PARAMS")){
+		preload_parameters("next", getenv("BNN_NEXT_PARAMS"));
+		ModelRegistryInstance().requestSwitch("next");
+	}
 
     //Allocate memories
+	std::shared_ptr<const NetworkTopology> topology = FoldedMVTopology();
     // # of ExtMemWords per input
-	const unsigned int psi = 384; //paddedSize(imgs.size()*inWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
+	unsigned int psi = topology->inWords();
 	// # of ExtMemWords per output
-	const unsigned int pso = 16; //paddedSize(64*outWidth, bitsPerExtMemWord) / bitsPerExtMemWord;
-	if(INPUT_BUF_ENTRIES < psi)
-	throw "Not enough space in accelBufIn";
-	if(OUTPUT_BUF_ENTRIES < pso)
-	throw "Not enough space in accelBufOut";
-	// allocate host-side buffers for packed input and outputs
-	ExtMemWord * packedImages = (ExtMemWord *)sds_alloc((count * psi)*sizeof(ExtMemWord));
-	ExtMemWord * packedOut = (ExtMemWord *)sds_alloc((count * pso)*sizeof(ExtMemWord));
-
-
-	//Open webcam
-	VideoCapture cap(0 + CV_CAP_V4L2);
-	if(!cap.open(0 + CV_CAP_V4L2))
-	{
-		cout << "cannot open camera" << endl;
+	unsigned int pso = topology->outWords();
+	// host-side ring of packed input and output buffers: a frame is classified while the next one is captured
+	std::unique_ptr<InferenceQueue> bnn_queue(new InferenceQueue(2, psi, pso));
+	InferenceQueue::Ticket bnn_ticket = 0;
+	auto bnn_start = chrono::high_resolution_clock::now();	//time statistics, when the bnn of the current frame was started
+
+
+	//Open webcam (or the replay named by BNN_CAPTURE)
+	std::unique_ptr<FrameSource> camera;
+	try {
+		camera = openFrameSource(defaultCaptureSource(), frame_width, frame_height);
+	} catch(const char * e) {
+		cout << "cannot open camera: " << e << endl;
 		return 0;
 	}
-	cap.set(CV_CAP_PROP_FRAME_WIDTH,frame_width);
-	cap.set(CV_CAP_PROP_FRAME_HEIGHT,frame_height);
-	cap >> cur_frame; //will be dropped, just for initialisation
+	Frame frame = camera->grab();	//initialises the filters and is the first frame processed
+	Frame next_frame;	//captured while the current frame is processed
+	if (!frame){
+		cout << "no frames to capture" << endl;
+		return 0;
+	}
+	cur_frame = frame.mat();
 
 	//Initialise Configures for Roi, Window and Uncertainty Filter
 	std::string uncertainty_config = "en"; //Entropy as Uncertainty Estimation Scheme
@@ -441,7 +436,9 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 	int ps_mode = 0;
 	int frames_dropped = 0;
 	unsigned int adjusted_output = 0;
-	cv::Mat display_frame = cur_frame.clone();
+	cv::Mat display_frame = cur_frame;
+	//BNN_DISPLAY=0 runs without a window, YUV frames are then never converted to BGR
+	const bool display = !getenv("BNN_DISPLAY") || strcmp(getenv("BNN_DISPLAY"), "0") != 0;
 	int pastclk = 100;
 	float acc_time = 0;
 	int processed_frames = 0;
@@ -449,10 +446,44 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 	string display_output = "";
 	Rect display_roi(Point(0,0), Point(frame_width, frame_height));
 	bool process_frame = true;
-	std::vector<float> class_result;
+	ScoreFrame scores;	//decoded output of the current frame
 
     while(frame_num < no_of_frame){
 
+		if (frame_num > 0){
+			//process the frame captured during the previous iteration, the one before goes back to the camera
+			if (!next_frame){
+				break;	//end of a replay, or a capture error
+			}
+			frame = std::move(next_frame);
+			next_frame.release();
+		}
+
+		//between two frames, with no image in flight: make a requested network switch once the
+		//network has loaded, and take sizes and classes from the network actually running
+		//a network that fails to load is dropped, the running one stays
+		try {
+			if (ModelRegistryInstance().switchRequested()){
+				cout << "Switched to network " << ModelRegistryInstance().active() << endl;
+			}
+		} catch(const char * e) {
+			cout << "network switch failed: " << e << endl;
+		} catch(...) {
+			cout << "network switch failed" << endl;
+		}
+		std::shared_ptr<const NetworkTopology> running = FoldedMVTopology();
+		if (running.get() != topology.get()){
+			topology = running;
+			psi = topology->inWords();
+			pso = topology->outWords();
+			number_class = topology->classes;
+			classes.resize(number_class);
+			for (unsigned int c = 0; c < number_class; c++){
+				classes[c] = c < topology->classNames.size() ? topology->classNames[c] : std::to_string(c);
+			}
+			bnn_queue.reset(new InferenceQueue(2, psi, pso));
+		}
+
 		auto t0 = chrono::high_resolution_clock::now(); //time statistics
 
 		Rect roi(Point(0,0), Point(frame_width, frame_height));
@@ -480,8 +511,11 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 				//Capture Frame Function
 				auto t1 = chrono::high_resolution_clock::now(); //time statistics
 
-				cap >> cur_frame;
-				display_frame = cur_frame.clone();
+				try {
+					next_frame = camera->grab();
+				} catch(const char * e) {
+					cout << "capture failed: " << e << endl;
+				}
 
 				auto t2 = chrono::high_resolution_clock::now();	//time statistics
 				cap_time = chrono::duration_cast<chrono::microseconds>( t2 - t1 ).count();
@@ -492,10 +526,12 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 				//ROI Functions
 				auto t3 = chrono::high_resolution_clock::now(); //time statistics
 				if (process_frame){
+					ExtMemWord * packedImages = bnn_queue->next();
+					prep.loadFrame(frame);
 
 					if (roi_config == "eff-roi"){
 
-						cv::resize(cur_frame, reduced_roi_frame, cv::Size(80, 60), 0, 0, cv::INTER_CUBIC);
+						prep.resizeGrey(reduced_roi_frame);
 						if (ps_mode != 1){
 							r_filter.init_enhanced_roi(reduced_roi_frame);
 						}
@@ -520,16 +556,12 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 							roi = r_filter.get_past_roi();
 						}
 
-						src = cur_frame(roi);
-						cv::resize(src, reduced_sized_frame, cv::Size(32, 32), 0, 0, cv::INTER_CUBIC );
-						flatten_mat(reduced_sized_frame, bgr);
-						vec_t img;
-						std::transform(bgr.begin(), bgr.end(), std::back_inserter(img),[=](unsigned char c) { return scale_min + (scale_max - scale_min) * c / 255; });
-						quantiseAndPack<8, 1>(img, &packedImages[0], psi);
+						prep.resize(roi, reduced_sized_frame);
+						encoder.encode(reduced_sized_frame, packedImages, psi);
 
 					} else if (roi_config == "opt-roi"){
 
-						cv::resize(cur_frame, reduced_roi_frame, cv::Size(80, 60), 0, 0, cv::INTER_CUBIC );
+						prep.resizeGrey(reduced_roi_frame);
 						//cv::resize(cur_frame, reduced_roi_frame, cv::Size(320, 240), 0, 0, cv::INTER_CUBIC );
 
 						if (frame_num < 2){
@@ -539,17 +571,13 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 							roi = r_filter.enhanced_roi(reduced_roi_frame);
 						}
 
-						src = cur_frame(roi);
-						cv::resize(src, reduced_sized_frame, cv::Size(32, 32), 0, 0, cv::INTER_CUBIC );
-						flatten_mat(reduced_sized_frame, bgr);
-						vec_t img;
-						std::transform(bgr.begin(), bgr.end(), std::back_inserter(img),[=](unsigned char c) { return scale_min + (scale_max - scale_min) * c / 255; });
-						quantiseAndPack<8, 1>(img, &packedImages[0], psi);
+						prep.resize(roi, reduced_sized_frame);
+						encoder.encode(reduced_sized_frame, packedImages, psi);
 
 
 					} else if (roi_config == "cont-roi") {
 						
-						cv::resize(cur_frame, reduced_roi_frame, cv::Size(80, 60), 0, 0, cv::INTER_CUBIC );
+						prep.resizeGrey(reduced_roi_frame);
 						//cv::resize(cur_frame, reduced_roi_frame, cv::Size(320, 240), 0, 0, cv::INTER_CUBIC );
 
 						if (frame_num < 2){
@@ -558,22 +586,15 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 							roi = r_filter.basic_roi(reduced_roi_frame);
 						}
 
-						src = cur_frame(roi);
-						cv::resize(src, reduced_sized_frame, cv::Size(32, 32), 0, 0, cv::INTER_CUBIC );
-						flatten_mat(reduced_sized_frame, bgr);
-						vec_t img;
-						std::transform(bgr.begin(), bgr.end(), std::back_inserter(img),[=](unsigned char c) { return scale_min + (scale_max - scale_min) * c / 255; });
-						quantiseAndPack<8, 1>(img, &packedImages[0], psi);
+						prep.resize(roi, reduced_sized_frame);
+						encoder.encode(reduced_sized_frame, packedImages, psi);
 
 
 					} else {
 
 						//use full frame all the time, no roi
-						cv::resize(cur_frame, reduced_sized_frame, cv::Size(32, 32), 0, 0, cv::INTER_CUBIC );
-						flatten_mat(reduced_sized_frame, bgr);
-						vec_t img;
-						std::transform(bgr.begin(), bgr.end(), std::back_inserter(img),[=](unsigned char c) { return scale_min + (scale_max - scale_min) * c / 255; });
-						quantiseAndPack<8, 1>(img, &packedImages[0], psi);
+						prep.resize(reduced_sized_frame);
+						encoder.encode(reduced_sized_frame, packedImages, psi);
 
 					}
 				}
@@ -581,6 +602,12 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 				auto t4 = chrono::high_resolution_clock::now();	//time statistics
 				preprocessing_time = chrono::duration_cast<chrono::microseconds>( t4 - t3 ).count();
 
+				//[Hardware-Related Functions] Start the bnn, it runs while the other section is still capturing the next frame
+				if (process_frame){
+					bnn_start = chrono::high_resolution_clock::now();
+					bnn_ticket = bnn_queue->submit();
+				}
+
 			}
 		}
 		auto t5 = chrono::high_resolution_clock::now();	//time statistics
@@ -588,36 +615,24 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 
 		//If using dynamic clock, change clock frquency to high settings when level of certainty is low
 		if (process_frame){
-			//[Hardware-Related Functions] Call the bnn
-			kernelbnn((ap_uint<64> *)packedImages, (ap_uint<64> *)packedOut, false, 0, 0, 0, 0, count,psi,pso,1,0);
-			if (frame_num != 1)
-			{
-				kernelbnn((ap_uint<64> *)packedImages, (ap_uint<64> *)packedOut, false, 0, 0, 0, 0, count,psi,pso,0,1);
-			}
+			//[Hardware-Related Functions] Wait for the bnn started after preprocessing
+			const ExtMemWord * packedOut = bnn_queue->wait(bnn_ticket);
 			//Extract the output of BNN and classify result
-			//std::vector<float> class_result;
-			class_result.clear();
-			copyFromLowPrecBuffer<unsigned short>(&packedOut[0], outTest);
-			for(unsigned int j = 0; j < number_class; j++) {			
-				class_result.push_back(outTest[j]);
-			}
-			output = distance(class_result.begin(),max_element(class_result.begin(), class_result.end()));
+			scores.decode((const uint16_t *)packedOut, number_class);
+			output = scores.argmax();
 
 			auto t6 = chrono::high_resolution_clock::now();	//time statistics
-			bnn_time = chrono::duration_cast<chrono::microseconds>( t6 - t5 ).count();
+			bnn_time = chrono::duration_cast<chrono::microseconds>( t6 - bnn_start ).count();	//overlaps the capture, see parallel_time
 
 			//Data post-processing:
 			//calculate uncertainty
-			u = u_filter.cal_uncertainty(class_result,uncertainty_config, output);
+			u = u_filter.cal_uncertainty(scores,uncertainty_config, output);
 			ps_mode = u[3];
 
 			auto t7 = chrono::high_resolution_clock::now();	//time statistics
 			uncertainty_time = chrono::duration_cast<chrono::microseconds>( t7 - t6 ).count();
 		} else {
-			class_result.clear();
-			for(unsigned int j = 0; j < number_class; j++) {			
-				class_result.push_back(0);
-			}
+			scores.clear(number_class);
 		}
 
 		if (process_frame){
@@ -632,14 +647,14 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 			case 2: aa=1,bb=1,cc=15,dd=15,ee=15,ff=12,gg=15,hh=10,ii=10,jj=8; break;
 			case 3: aa=1,bb=1,cc=10,dd=8,ee=15,ff=12,gg=15,hh=10,ii=10,jj=6; break;
 		}
-		adjusted_output = w_filter.analysis(class_result,ps_mode, win_config, aa, bb, cc, dd, ee, ff, gg, hh, ii, jj); //if win_config is true, win_step and length are flexible, else they are fixed to 8 12
+		adjusted_output = w_filter.analysis(scores,ps_mode, win_config, aa, bb, cc, dd, ee, ff, gg, hh, ii, jj); //if win_config is true, win_step and length are flexible, else they are fixed to 8 12
 		auto t9 = chrono::high_resolution_clock::now();	//time statistics
 		wfilter_time = chrono::duration_cast<chrono::microseconds>( t9 - t8).count();
 		float overall_time = chrono::duration_cast<chrono::microseconds>( t9 - t0 ).count();
 
 		std::cout << "adjusted output: " << adjusted_output << endl;
-		if (adjusted_output > 9){
-			adjusted_output = 9;
+		if (adjusted_output > number_class - 1){
+			adjusted_output = number_class - 1;
 		}
 
 		//---------------------------------------Below output result to users and stored them on CSV files---------------------------------------------------------------
@@ -650,8 +665,10 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 
 		if (frame_num == 0){
 			myfile << frame_num << "\n" ;
-			imshow("Original", display_frame);
-			waitKey(25);
+			if (display){
+				imshow("Original", display_frame);
+				waitKey(25);
+			}
 			frame_num++;
 			continue; // exclude first frame from calculation skip the remaining code in the loop
 		}
@@ -704,14 +721,19 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 			total_un += (float)uncertainty_time;
 		}
 
-		//Display output
+		frame_num++;
+
+		if (!display){
+			continue;
+		}
+
+		//Display output, drawn on the processed frame itself (only YUV frames are converted, for display)
+		display_frame = frame.mat();
 		rectangle(display_frame, display_roi, Scalar(0, 0, 255));
 		putText(display_frame, display_output, Point(15, 55), FONT_HERSHEY_PLAIN, 1, Scalar(0, 255, 0));	
 		imshow("Original", display_frame);
 		waitKey(25);
 
-		frame_num++;
-
 		char ESC = waitKey(1);	
 		if (ESC == 27) 
         {
@@ -741,11 +763,12 @@ int classify_frames(unsigned int no_of_frame, int scheme, int expected_class){
 	myfile << "\n \n";
 	myfile.close();
 
-	cap.release();
+	frame.release();
+	next_frame.release();
+	camera.reset();
 	//reset clock to 100MHz
 	config_clock(100);
     //[Hardware-Related Functions] Release memory
-    sds_free(packedImages);
-	sds_free(packedOut);
+    bnn_queue.reset();
     return 1;
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+/******************************************************************************
+ *
+ *
+ * @file model-registry.cpp
+ *
+ * Resident networks with background loading, see model-registry.h.
+ *
+ *
+ *****************************************************************************/
+#include "model-registry.h"
+#include <chrono>
+
+using namespace std;
+
+void ModelRegistry::preload(const string & name, const string & dir) {
+  Pending p = async(launch::async, FoldedMVPrepareModel, dir).share();
+  Pending replaced;
+  {
+    lock_guard<mutex> g(lock);
+    replaced = models[name];
+    models[name] = p;
+  }
+  // released outside the lock, the last reference to a load waits for it
+}
+
+ModelRegistry::Pending ModelRegistry::find(const string & name) const {
+  lock_guard<mutex> g(lock);
+  map<string, Pending>::const_iterator it = models.find(name);
+  if(it == models.end())
+    throw "Unknown network";
+  return it->second;
+}
+
+bool ModelRegistry::ready(const string & name) const {
+  return find(name).wait_for(chrono::seconds(0)) == future_status::ready;
+}
+
+shared_ptr<const NetworkTopology> ModelRegistry::activate(const string & name) {
+  // get() waits for the load and rethrows its errors
+  shared_ptr<const NetworkTopology> t = FoldedMVActivateModel(find(name).get());
+  lock_guard<mutex> g(lock);
+  current = name;
+  return t;
+}
+
+bool ModelRegistry::tryActivate(const string & name) {
+  if(!ready(name))
+    return false;
+  activate(name);
+  return true;
+}
+
+void ModelRegistry::requestSwitch(const string & name) {
+  lock_guard<mutex> g(lock);
+  requested = name;
+}
+
+bool ModelRegistry::switchRequested() {
+  string name;
+  {
+    lock_guard<mutex> g(lock);
+    if(requested.empty() || requested == current)
+      return false;
+    name = requested;
+  }
+  try {
+    if(!tryActivate(name))
+      return false;
+  } catch(...) {
+    // a network that failed to load is not tried again on every frame
+    lock_guard<mutex> g(lock);
+    if(requested == name)
+      requested.clear();
+    throw;
+  }
+  lock_guard<mutex> g(lock);
+  // unless another switch was asked for in the meantime
+  if(requested == name)
+    requested.clear();
+  return true;
+}
+
+string ModelRegistry::active() const {
+  lock_guard<mutex> g(lock);
+  return current;
+}
+
+void ModelRegistry::evict(const string & name) {
+  Pending p;
+  {
+    lock_guard<mutex> g(lock);
+    map<string, Pending>::iterator it = models.find(name);
+    if(it == models.end())
+      return;
+    p = it->second;
+    models.erase(it);
+  }
+  // a load still in progress is waited for outside the lock
+  p.wait();
+}
+
+ModelRegistry & ModelRegistryInstance() {
+  static ModelRegistry registry;
+  return registry;
+}
+
+extern "C" void preload_parameters(const char* name, const char* path) {
+  ModelRegistryInstance().preload(name, path);
+}
+
+extern "C" int switch_parameters(const char* name, int wait) {
+  FoldedMVInit("cnv-pynq");
+  if(!wait)
+    return ModelRegistryInstance().tryActivate(name) ? 1 : 0;
+  ModelRegistryInstance().activate(name);
+  return 1;
+}
@@ -0,0 +1,66 @@
+/******************************************************************************
+ *
+ *
+ * @file model-registry.h
+ *
+ * Several networks (parameter sets of params/) kept resident in host memory
+ * under a name each, so the running network can be switched without
+ * reloading. Loading happens on a background thread while the accelerator
+ * keeps classifying with the active network; the switch itself is done
+ * between two frames. On the software backend it only swaps a pointer, on
+ * the board the on-chip memories hold one network and are rewritten from
+ * the resident copy, which skips the file reads but not the upload.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "foldedmv-offload.h"
+
+class ModelRegistry {
+public:
+  // starts loading the network of params directory dir under name, replacing
+  // an earlier set of that name (the active network keeps running)
+  void preload(const std::string & name, const std::string & dir);
+  // true once name has finished loading, successfully or not
+  bool ready(const std::string & name) const;
+  // makes name the running network, waiting for it to finish loading first;
+  // throws if it is unknown or failed to load
+  std::shared_ptr<const NetworkTopology> activate(const std::string & name);
+  // as activate() but never waits: returns false if name is still loading
+  bool tryActivate(const std::string & name);
+  // asks for a switch to name, from any thread; the thread running the
+  // inference makes it with switchRequested() between two frames
+  void requestSwitch(const std::string & name);
+  // activates the requested network once it has loaded, true if the running
+  // network changed. Call between frames, with no image in flight. If the
+  // load failed, its error is thrown once and the request is dropped; the
+  // running network is left as it was.
+  bool switchRequested();
+  // name of the running network, empty if none was activated
+  std::string active() const;
+  // drops name from host memory, if active it keeps running until replaced
+  void evict(const std::string & name);
+
+private:
+  typedef std::shared_future<std::shared_ptr<FoldedMVModel> > Pending;
+
+  Pending find(const std::string & name) const;
+
+  std::map<std::string, Pending> models;
+  std::string current, requested;
+  mutable std::mutex lock;
+};
+
+// the registry behind preload_parameters()/switch_parameters()
+ModelRegistry & ModelRegistryInstance();
+
+// keeps the network in path resident under name, loading it in the background
+extern "C" void preload_parameters(const char* name, const char* path);
+// switches to a preloaded network between two frames; with wait == 0 returns
+// 0 instead of blocking while it is still loading
+extern "C" int switch_parameters(const char* name, int wait);
@@ -0,0 +1,153 @@
+/******************************************************************************
+ *
+ *
+ * @file parampack.cpp
+ *
+ * Writer and memory mapped reader of parameter packs, see parampack.h.
+ *
+ *
+ *****************************************************************************/
+#include "parampack.h"
+#include <string.h>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const uint64_t blobAlign = 64;
+
+static uint64_t alignUp(uint64_t v) {
+  return (v + blobAlign - 1) / blobAlign * blobAlign;
+}
+
+uint64_t paramPackChecksum(const void * data, size_t bytes) {
+  const unsigned char * p = (const unsigned char *)data;
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for(size_t i = 0; i < bytes; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+// reads a memory image of the given number of words; like the per-word
+// loader, a short file leaves the remaining words zero
+static void readMem(const string & fileName, uint64_t * dst, unsigned int words) {
+  ifstream f(fileName, ios::binary | ios::in);
+  if(!f.is_open())
+    throw "Could not open file";
+  f.read((char *)dst, words * sizeof(uint64_t));
+}
+
+void writeParamPack(const string & paramsDir, const NetworkTopology & t, const string & packFile) {
+  const unsigned int numLayers = t.layers.size();
+  vector<ParamPackLayer> index(numLayers);
+  uint64_t offset = alignUp(sizeof(ParamPackHeader) + numLayers * sizeof(ParamPackLayer));
+  for(unsigned int l = 0; l < numLayers; l++) {
+    const LayerTopology & lt = t.layers[l];
+    ParamPackLayer & e = index[l];
+    e.pe = lt.pe;
+    e.wmem = lt.wmem;
+    e.tmem = lt.tmem;
+    e.reserved = 0;
+    e.weightsOffset = offset;
+    offset = alignUp(offset + (uint64_t)lt.pe * lt.wmem * sizeof(uint64_t));
+    e.thresOffset = offset;
+    offset = alignUp(offset + (uint64_t)lt.pe * lt.tmem * sizeof(uint64_t));
+  }
+
+  vector<unsigned char> file(offset, 0);
+  memcpy(file.data() + sizeof(ParamPackHeader), index.data(), numLayers * sizeof(ParamPackLayer));
+  for(unsigned int l = 0; l < numLayers; l++) {
+    const ParamPackLayer & e = index[l];
+    for(unsigned int pe = 0; pe < e.pe; pe++) {
+      const string prefix = paramsDir + "/" + to_string(l) + "-" + to_string(pe);
+      readMem(prefix + "-weights.bin", (uint64_t *)&file[e.weightsOffset] + pe * e.wmem, e.wmem);
+      readMem(prefix + "-thres.bin", (uint64_t *)&file[e.thresOffset] + pe * e.tmem, e.tmem);
+    }
+  }
+
+  ParamPackHeader h;
+  memcpy(h.magic, paramPackMagic, sizeof(h.magic));
+  h.version = paramPackVersion;
+  h.numLayers = numLayers;
+  h.size = file.size();
+  h.checksum = paramPackChecksum(file.data() + sizeof(h), file.size() - sizeof(h));
+  memcpy(file.data(), &h, sizeof(h));
+
+  ofstream out(packFile, ios::binary | ios::out | ios::trunc);
+  if(!out.is_open())
+    throw "Could not create parameter pack";
+  out.write((const char *)file.data(), file.size());
+  if(!out)
+    throw "Could not write parameter pack";
+}
+
+ParamPack::ParamPack(const string & packFile) : base(nullptr), size(0) {
+  int fd = open(packFile.c_str(), O_RDONLY);
+  if(fd < 0)
+    throw "Could not open parameter pack";
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ParamPackHeader)) {
+    close(fd);
+    throw "Parameter pack truncated";
+  }
+  size = st.st_size;
+  void * p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED)
+    throw "Could not map parameter pack";
+  base = (const unsigned char *)p;
+
+  const char * error = nullptr;
+  ParamPackHeader h;
+  memcpy(&h, base, sizeof(h));
+  if(memcmp(h.magic, paramPackMagic, sizeof(h.magic)) != 0)
+    error = "Not a parameter pack";
+  else if(h.version != paramPackVersion)
+    error = "Unsupported parameter pack version";
+  else if(h.size != size || sizeof(h) + (uint64_t)h.numLayers * sizeof(ParamPackLayer) > size)
+    error = "Parameter pack truncated";
+  else if(paramPackChecksum(base + sizeof(h), size - sizeof(h)) != h.checksum)
+    error = "Parameter pack checksum mismatch";
+  if(!error) {
+    index.resize(h.numLayers);
+    memcpy(index.data(), base + sizeof(h), h.numLayers * sizeof(ParamPackLayer));
+    for(unsigned int l = 0; l < index.size() && !error; l++) {
+      const ParamPackLayer & e = index[l];
+      if(e.weightsOffset + (uint64_t)e.pe * e.wmem * sizeof(uint64_t) > size ||
+         e.thresOffset + (uint64_t)e.pe * e.tmem * sizeof(uint64_t) > size ||
+         e.weightsOffset % sizeof(uint64_t) != 0 || e.thresOffset % sizeof(uint64_t) != 0)
+        error = "Parameter pack index out of range";
+    }
+  }
+  if(error) {
+    munmap((void *)base, size);
+    throw error;
+  }
+}
+
+ParamPack::~ParamPack() {
+  munmap((void *)base, size);
+}
+
+const uint64_t * ParamPack::weights(unsigned int l, unsigned int pe) const {
+  return (const uint64_t *)(base + index[l].weightsOffset) + pe * index[l].wmem;
+}
+
+const uint64_t * ParamPack::thresholds(unsigned int l, unsigned int pe) const {
+  return (const uint64_t *)(base + index[l].thresOffset) + pe * index[l].tmem;
+}
+
+void ParamPack::check(const NetworkTopology & t) const {
+  if(t.layers.size() != index.size())
+    throw "Parameter pack does not match the network topology";
+  for(unsigned int l = 0; l < index.size(); l++) {
+    const LayerTopology & lt = t.layers[l];
+    if(lt.pe != index[l].pe || lt.wmem != index[l].wmem || lt.tmem != index[l].tmem)
+      throw "Parameter pack does not match the network topology";
+  }
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ *
+ * @file parampack.h
+ *
+ * Single file parameter pack of a network: the weight and threshold memory
+ * images of all layers and PEs, as otherwise spread over the
+ * <layer>-<pe>-weights.bin / -thres.bin files of a params/ directory.
+ *
+ * Layout (little endian), all blobs 64-byte aligned:
+ *
+ *   ParamPackHeader
+ *   ParamPackLayer[numLayers]         index, one entry per layer
+ *   blobs                             per layer: weights [pe][wmem] words,
+ *                                     then thresholds [pe][tmem] words
+ *
+ * The checksum (64-bit FNV-1a) covers everything after the header. The pack
+ * is mapped read-only and the blobs are used in place.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "topology.h"
+
+const char paramPackMagic[8] = {'B', 'N', 'N', 'P', 'A', 'C', 'K', 0};
+const uint32_t paramPackVersion = 1;
+
+struct ParamPackHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t numLayers;
+  uint64_t size;                // of the whole file
+  uint64_t checksum;            // of bytes [sizeof(ParamPackHeader), size)
+};
+
+struct ParamPackLayer {
+  uint32_t pe, wmem, tmem, reserved;
+  uint64_t weightsOffset;       // from the start of the file
+  uint64_t thresOffset;
+};
+
+// name of the pack inside a params directory
+const std::string paramPackName = "params.pack";
+
+uint64_t paramPackChecksum(const void * data, size_t bytes);
+
+// converts the per-PE .bin files of paramsDir (laid out as described by t)
+// into a pack at packFile
+void writeParamPack(const std::string & paramsDir, const NetworkTopology & t, const std::string & packFile);
+
+// a pack mapped into memory, throws if the file is missing, truncated, of
+// another version or fails the checksum
+class ParamPack {
+public:
+  explicit ParamPack(const std::string & packFile);
+  ~ParamPack();
+
+  unsigned int layers() const { return index.size(); }
+  const ParamPackLayer & layer(unsigned int l) const { return index[l]; }
+  // memory image of one PE, wmem (tmem) words
+  const uint64_t * weights(unsigned int l, unsigned int pe) const;
+  const uint64_t * thresholds(unsigned int l, unsigned int pe) const;
+
+  // throws unless the pack holds memories of the shape t expects
+  void check(const NetworkTopology & t) const;
+
+private:
+  ParamPack(const ParamPack &);
+  ParamPack & operator=(const ParamPack &);
+
+  const unsigned char * base;
+  size_t size;
+  std::vector<ParamPackLayer> index;
+};
@@ -0,0 +1,105 @@
+/******************************************************************************
+ *
+ *
+ * @file perfmodel.cpp
+ *
+ * Performance model of the dataflow accelerator, see perfmodel.h.
+ *
+ *
+ *****************************************************************************/
+#include "perfmodel.h"
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+
+static unsigned long long divUp(unsigned long long a, unsigned long long b) {
+  return (a + b - 1) / b;
+}
+
+unsigned long long NetworkPerf::callCycles(unsigned int numImages) const {
+  if(numImages == 0)
+    return 0;
+  return latency + (unsigned long long)(numImages - 1) * ii;
+}
+
+NetworkPerf modelPerformance(const NetworkTopology & t) {
+  NetworkPerf p;
+  p.inCycles = t.inWords();
+  p.outCycles = t.outWords();
+  p.ii = max(p.inCycles, p.outCycles);
+  p.bottleneck = 0;
+
+  // rows of the map coming into the layer, and when the first K of them and
+  // the last one have arrived
+  unsigned int rows = t.layers.front().ifmDim;
+  double prevStart = 0, prevDone = p.inCycles, prevRowCycles = (double)p.inCycles / rows;
+  for(unsigned int i = 0; i < t.layers.size(); i++) {
+    const LayerTopology & l = t.layers[i];
+    LayerPerf lp;
+    const unsigned long long nf = divUp(l.ofmCh, l.pe);
+    const unsigned long long sf = divUp((unsigned long long)l.k * l.k * l.ifmCh, l.simd);
+    const unsigned long long pixels = (unsigned long long)l.ofmDim * l.ofmDim;
+    lp.mvCycles = pixels * nf * sf;
+    // every output pixel takes SF words of its window, and the line buffer
+    // is filled with K rows before the first one
+    const bool conv = l.kind == LAYER_CONV || l.kind == LAYER_FXDCONV;
+    lp.swCycles = conv ? pixels * sf + (unsigned long long)l.k * l.ifmDim * divUp(l.ifmCh, l.simd) : 0;
+    lp.cycles = max(lp.mvCycles, lp.swCycles);
+
+    double start, done;
+    if(conv && rows > 1) {
+      // starts with K input rows, and after the last input row still has
+      // the last output row to compute
+      start = prevStart + prevRowCycles * l.k;
+      done = max(start + lp.cycles, prevDone + (double)lp.cycles / l.ofmDim);
+    } else {
+      start = prevDone;
+      done = start + lp.cycles;
+    }
+    lp.done = (unsigned long long)done;
+    p.layers.push_back(lp);
+    if(lp.cycles > p.layers[p.bottleneck].cycles)
+      p.bottleneck = i;
+    p.ii = max(p.ii, lp.cycles);
+
+    // a pooled row needs two rows of the convolution
+    rows = l.pool ? l.ofmDim / 2 : l.ofmDim;
+    prevRowCycles = (double)lp.cycles / rows;
+    prevStart = start;
+    prevDone = done;
+  }
+  p.latency = (unsigned long long)prevDone + p.outCycles;
+  return p;
+}
+
+static const char * kindName(LayerKind k) {
+  switch(k) {
+    case LAYER_FXDCONV: return "fxdconv";
+    case LAYER_CONV: return "conv";
+    case LAYER_FC: return "fc";
+    default: return "fc_noact";
+  }
+}
+
+void printPerformance(ostream & os, const NetworkTopology & t, const NetworkPerf & p) {
+  const double refMHz = 100;
+  os << "Network " << t.name << ", " << t.layers.size() << " layers" << endl;
+  os << "layer  type      PE SIMD    WMEM   mv cycles   sw cycles   fps@" << refMHz << "MHz" << endl;
+  for(unsigned int i = 0; i < p.layers.size(); i++) {
+    const LayerTopology & l = t.layers[i];
+    const LayerPerf & lp = p.layers[i];
+    os << setw(5) << i << "  " << left << setw(8) << kindName(l.kind) << right
+       << setw(4) << l.pe << setw(5) << l.simd << setw(8) << l.wmem
+       << setw(12) << lp.mvCycles << setw(12) << lp.swCycles
+       << setw(12) << fixed << setprecision(0) << refMHz * 1e6 / lp.cycles
+       << (i == p.bottleneck ? "  <- bottleneck" : "") << endl;
+  }
+  os << "input " << p.inCycles << " cycles, output " << p.outCycles << " cycles" << endl;
+  os << "II " << p.ii << " cycles, latency " << p.latency << " cycles" << endl;
+  os << "  MHz       fps  latency us" << endl;
+  for(unsigned int i = 0; i < sizeof(plClocksMHz) / sizeof(plClocksMHz[0]); i++)
+    os << setw(5) << plClocksMHz[i] << setw(10) << setprecision(0) << p.fps(plClocksMHz[i])
+       << setw(12) << setprecision(1) << p.latencyUs(plClocksMHz[i]) << endl;
+  os.unsetf(ios::floatfield);
+}
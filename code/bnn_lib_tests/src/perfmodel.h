@@ -0,0 +1,50 @@
+/******************************************************************************
+ *
+ *
+ * @file perfmodel.h
+ *
+ * Cycle-approximate performance model of the FINN dataflow accelerator for a
+ * network topology. Each layer's matrix-vector unit needs NF * SF cycles per
+ * output pixel (neuron fold NF = OFM_CH / PE, synapse fold SF =
+ * K * K * IFM_CH / SIMD, i.e. WMEM), so OFM_DIM^2 * NF * SF per image; its
+ * sliding window unit has to read the input map and fill K lines first. The
+ * layers run concurrently, so in steady state an image leaves the pipeline
+ * every II (initiation interval) cycles, the cycles of the slowest stage.
+ * The latency of a single image follows the rows through the layers: a
+ * convolution can start once K input rows are there, a fully connected
+ * layer only when its whole input is.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <ostream>
+#include <vector>
+#include "topology.h"
+
+// PL clocks config_clock() can set, in MHz
+const unsigned int plClocksMHz[] = {20, 25, 33, 50, 100, 111, 125, 143, 166};
+
+struct LayerPerf {
+  unsigned long long mvCycles;      // matrix-vector unit, per image
+  unsigned long long swCycles;      // sliding window unit, per image
+  unsigned long long cycles;        // of the stage, the slower of the two
+  unsigned long long done;          // cycle the layer finishes one image
+};
+
+struct NetworkPerf {
+  std::vector<LayerPerf> layers;
+  unsigned long long inCycles, outCycles;   // input/output streams, one word per cycle
+  unsigned int bottleneck;          // index of the slowest layer
+  unsigned long long ii;            // cycles between images in steady state
+  unsigned long long latency;       // cycles from the first input word to the last output word
+
+  // cycles for one kernelbnn() call of numImages images
+  unsigned long long callCycles(unsigned int numImages) const;
+  double fps(double mhz) const { return mhz * 1e6 / ii; }
+  double latencyUs(double mhz) const { return latency / mhz; }
+};
+
+NetworkPerf modelPerformance(const NetworkTopology & t);
+
+// per-layer table and the end-to-end figures at every clock of plClocksMHz
+void printPerformance(std::ostream & os, const NetworkTopology & t, const NetworkPerf & p);
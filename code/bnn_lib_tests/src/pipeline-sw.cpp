@@ -0,0 +1,109 @@
+/******************************************************************************
+ *
+ *
+ * @file pipeline-sw.cpp
+ *
+ * Layer-pipelined execution for the software backend, see pipeline-sw.h.
+ *
+ *
+ *****************************************************************************/
+#include "pipeline-sw.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+SwPipeline::SwPipeline(const SwNetwork & net, unsigned int stages, unsigned int depth)
+  : net(net), frames(max(depth, 1u)), numSubmitted(0), numDone(0) {
+  const unsigned int numLayers = net.layers.size();
+  stages = max(1u, min(stages, numLayers));
+
+  // cut the layers into stages of about equal work, at least one layer each
+  unsigned long long total = 0;
+  for(unsigned int i = 0; i < numLayers; i++)
+    total += net.work(i);
+  bounds.push_back(0);
+  unsigned long long done = 0;
+  for(unsigned int i = 0; i < numLayers && bounds.size() < stages; i++) {
+    done += net.work(i);
+    const unsigned int s = bounds.size();
+    if(done * stages >= total * s || numLayers - (i + 1) == stages - s)
+      bounds.push_back(i + 1);
+  }
+  bounds.push_back(numLayers);
+
+  for(unsigned int i = 0; i < frames.size(); i++) {
+    net.allocMaps(frames[i].maps);
+    idle.push_back(&frames[i]);
+  }
+  for(unsigned int s = 0; s <= this->stages(); s++)
+    queues.push_back(new SpscQueue<Frame *>(frames.size() + 1));
+  for(unsigned int s = 0; s < this->stages(); s++)
+    threads.push_back(thread(&SwPipeline::stage, this, s));
+}
+
+SwPipeline::~SwPipeline() {
+  drain();
+  // a null frame tells each stage to pass it on and stop
+  queues[0]->push(nullptr);
+  for(unsigned int s = 0; s < threads.size(); s++)
+    threads[s].join();
+  for(unsigned int s = 0; s < queues.size(); s++)
+    delete queues[s];
+}
+
+void SwPipeline::stage(unsigned int s) {
+#ifdef __linux__
+  // one core per stage, the stages never compete for a core themselves
+  const unsigned int cores = max(1u, thread::hardware_concurrency());
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(s % cores, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+  SwScratch scratch;
+  for(;;) {
+    Frame * f = queues[s]->pop();
+    if(f)
+      net.runLayers(f->in, f->out, f->maps, scratch, bounds[s], bounds[s + 1]);
+    if(f || s + 1 < stages())
+      queues[s + 1]->push(f);
+    if(!f)
+      return;
+  }
+}
+
+void SwPipeline::submit(const ExtMemWord * in, ExtMemWord * out) {
+  if(idle.empty()) {
+    // reuse the frame of the oldest image, which completes first
+    idle.push_back(queues[stages()]->pop());
+    numDone++;
+  }
+  Frame * f = idle.back();
+  idle.pop_back();
+  f->in = in;
+  f->out = out;
+  queues[0]->push(f);
+  numSubmitted++;
+}
+
+void SwPipeline::drain() {
+  waitFor(numSubmitted);
+}
+
+void SwPipeline::waitFor(unsigned long long n) {
+  for(; numDone < n; numDone++)
+    idle.push_back(queues[stages()]->pop());
+}
+
+bool SwPipeline::tryWaitFor(unsigned long long n) {
+  Frame * f;
+  for(; numDone < n; numDone++) {
+    if(!queues[stages()]->tryPop(f))
+      return false;
+    idle.push_back(f);
+  }
+  return true;
+}
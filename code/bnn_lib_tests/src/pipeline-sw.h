@@ -0,0 +1,113 @@
+/******************************************************************************
+ *
+ *
+ * @file pipeline-sw.h
+ *
+ * Layer-pipelined execution for the software backend, the CPU counterpart of
+ * the dataflow pipeline of the hardware (PIPELINE_DEPTH in
+ * foldedmv-offload.h). The layers are split into stages of about equal work,
+ * each run by its own thread pinned to a core, and the stages pass frames
+ * (an image with its feature maps) through bounded lock-free single
+ * producer/single consumer queues. Image N+1 enters layer 0 while image N is
+ * still in a later stage, so throughput scales with the stages without
+ * batching up images first.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "kernelbnn-sw.h"
+
+// bounded ring buffer for exactly one producer and one consumer thread
+template<typename T>
+class SpscQueue {
+public:
+  explicit SpscQueue(unsigned int capacity) : slots(capacity + 1), head(0), tail(0) {}
+
+  bool tryPush(const T & v) {
+    const unsigned int t = tail.load(std::memory_order_relaxed);
+    const unsigned int n = (t + 1) % slots.size();
+    if(n == head.load(std::memory_order_acquire))
+      return false;
+    slots[t] = v;
+    tail.store(n, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T & v) {
+    const unsigned int h = head.load(std::memory_order_relaxed);
+    if(h == tail.load(std::memory_order_acquire))
+      return false;
+    v = slots[h];
+    head.store((h + 1) % slots.size(), std::memory_order_release);
+    return true;
+  }
+
+  // blocking variants, spin briefly and then yield the core
+  void push(const T & v) {
+    for(unsigned int spin = 0; !tryPush(v); spin++)
+      if(spin > 64)
+        std::this_thread::yield();
+  }
+
+  T pop() {
+    T v;
+    for(unsigned int spin = 0; !tryPop(v); spin++)
+      if(spin > 64)
+        std::this_thread::yield();
+    return v;
+  }
+
+private:
+  // padded onto separate cache lines, each index is written by one side only.
+  // Padding rather than alignas(64), which plain new does not honour before
+  // C++17.
+  std::vector<T> slots;
+  char padSlots[64];
+  std::atomic<unsigned int> head;
+  char padHead[64 - sizeof(std::atomic<unsigned int>)];
+  std::atomic<unsigned int> tail;
+  char padTail[64 - sizeof(std::atomic<unsigned int>)];
+};
+
+class SwPipeline {
+public:
+  // splits net into (at most) the given number of stages, with depth frames
+  // in flight; net must stay unchanged while images are in flight
+  SwPipeline(const SwNetwork & net, unsigned int stages, unsigned int depth = PIPELINE_DEPTH);
+  ~SwPipeline();
+
+  // queues one image, blocking while all frames are in flight. in and out
+  // have to stay valid until the image is classified.
+  void submit(const ExtMemWord * in, ExtMemWord * out);
+  // waits until all submitted images are classified
+  void drain();
+  // images submitted so far; waitFor(n) waits until the first n of them are
+  // classified, tryWaitFor(n) only checks without blocking
+  unsigned long long submitted() const { return numSubmitted; }
+  void waitFor(unsigned long long n);
+  bool tryWaitFor(unsigned long long n);
+
+  unsigned int stages() const { return (unsigned int)bounds.size() - 1; }
+
+private:
+  struct Frame {
+    const ExtMemWord * in;
+    ExtMemWord * out;
+    SwScratch maps;
+  };
+
+  void stage(unsigned int s);
+
+  const SwNetwork & net;
+  std::vector<unsigned int> bounds;       // stage s runs layers [bounds[s], bounds[s+1])
+  std::vector<Frame> frames;
+  std::vector<Frame *> idle;              // frames not in flight
+  // queues[s] feeds stage s, queues[stages] returns finished frames
+  std::vector<SpscQueue<Frame *> *> queues;
+  std::vector<std::thread> threads;
+  // images are classified in order, the first numDone of them are finished
+  unsigned long long numSubmitted, numDone;
+};
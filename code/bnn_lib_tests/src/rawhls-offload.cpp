@@ -41,35 +41,99 @@
 
 #include "foldedmv-offload.h"
 #include <string.h>
+#include <memory>
 #include <vector>
 #include <iostream>
 #include "sds_lib.h"
+#ifdef SW_BACKEND
+#include "kernelbnn-sw.h"
+#endif
 
 using namespace std;
 using namespace tiny_cnn;
 
 ExtMemWord * bufIn, * bufOut;
+unsigned int bufInWords, bufOutWords;
+// pool buffers behind bufIn/bufOut
+static DmaBuffer bufInMem, bufOutMem;
 
-void FoldedMVInit(const char * attachName) {
-   
-  if (!bufIn) {
-    //bufIn = new ExtMemWord[INPUT_BUF_ENTRIES];
-    //printf("Allocating sds alloc buffers\n");
-    bufIn = (ExtMemWord *)sds_alloc(INPUT_BUF_ENTRIES*sizeof(ExtMemWord));
-    if (!bufIn) throw "Failed to allocate host buffer";
+#ifndef SW_BACKEND
+// the network loaded into the accelerator, replaced as a whole
+static shared_ptr<const NetworkTopology> & activeTopology() {
+  static shared_ptr<const NetworkTopology> topology = make_shared<NetworkTopology>(defaultTopology());
+  return topology;
+}
+#endif
+
+shared_ptr<const NetworkTopology> FoldedMVTopology() {
+#ifdef SW_BACKEND
+  // the topology held by the active network, so the two change in one swap
+  const shared_ptr<SwNetwork> net = SwActiveNetwork();
+  return shared_ptr<const NetworkTopology>(net, &net->topology);
+#else
+  return atomic_load(&activeTopology());
+#endif
+}
+
+// sizes bufIn/bufOut for one image of the active network, buffers that are
+// already large enough are kept
+static void sizeHostBuffers() {
+  const shared_ptr<const NetworkTopology> topology = FoldedMVTopology();
+  const NetworkTopology & t = *topology;
+  if(bufInMem.size() < t.inWords() * sizeof(ExtMemWord)) {
+    bufInMem = DmaBufferPoolInstance().acquire(t.inWords() * sizeof(ExtMemWord));
+    bufIn = bufInMem.as<ExtMemWord>();
+    bufInWords = bufInMem.size() / sizeof(ExtMemWord);
   }
-  if (!bufOut) {
-    //bufOut = new ExtMemWord[OUTPUT_BUF_ENTRIES];
-    bufOut = (ExtMemWord *)sds_alloc(OUTPUT_BUF_ENTRIES*sizeof(ExtMemWord));
-    if (!bufOut) throw "Failed to allocate host buffer";
+  if(bufOutMem.size() < t.outWords() * sizeof(ExtMemWord)) {
+    bufOutMem = DmaBufferPoolInstance().acquire(t.outWords() * sizeof(ExtMemWord));
+    bufOut = bufOutMem.as<ExtMemWord>();
+    bufOutWords = bufOutMem.size() / sizeof(ExtMemWord);
   }
 }
 
+void FoldedMVInit(const char * attachName) {
+  sizeHostBuffers();
+}
+
 void FoldedMVDeinit() {
-  delete bufIn;
-  delete bufOut;
+  bufInMem.reset();
+  bufOutMem.reset();
   bufIn = 0;
   bufOut = 0;
+  bufInWords = 0;
+  bufOutWords = 0;
+  DmaBufferPoolInstance().trim();
+}
+
+#ifndef SW_BACKEND
+// the bitstream fixes the layer shapes and folding, a network can only be
+// loaded if it has the same structure and fits into the on-chip memories
+static void checkAccelerator(const NetworkTopology & topology) {
+  const NetworkTopology hw = defaultTopology();
+  if(topology.layers.size() != hw.layers.size())
+    throw "Network does not match the accelerator";
+  for(unsigned int i = 0; i < hw.layers.size(); i++) {
+    const LayerTopology & a = topology.layers[i], & b = hw.layers[i];
+    if(a.kind != b.kind || a.k != b.k || a.ifmCh != b.ifmCh || a.ifmDim != b.ifmDim ||
+       a.ofmCh != b.ofmCh || a.ofmDim != b.ofmDim || a.pool != b.pool ||
+       a.simd != b.simd || a.pe != b.pe || a.wmem > b.wmem || a.tmem > b.tmem)
+      throw "Network does not match the accelerator";
+  }
+}
+#endif
+
+void FoldedMVSetTopology(const NetworkTopology & topology) {
+#ifdef SW_BACKEND
+  // a fresh network rather than reconfiguring the running one, which may be
+  // a model kept resident by the caller
+  SwActivateNetwork(make_shared<SwNetwork>(topology));
+#else
+  checkAccelerator(topology);
+  atomic_store(&activeTopology(), shared_ptr<const NetworkTopology>(make_shared<NetworkTopology>(topology)));
+#endif
+  if(bufIn)
+    sizeHostBuffers();
 }
 
 void FoldedMVOffload(const tiny_cnn::vec_t &in,
@@ -77,7 +141,7 @@ void FoldedMVOffload(const tiny_cnn::vec_t &in,
                      unsigned int offloadID,
                      tiny_cnn::OffloadConvParams * convParams) {
   // binarize input and pack into bit stream
-  binarizeAndPack(in, bufIn);
+  binarizeAndPack(in, bufIn, bufInWords);
 
   // call the accelerator in compute mode
   //kernelbnn((ap_uint<64> *)bufIn, (ap_uint<64> *)bufOut, false, 0, 0, 0, 0,0,0,0);
@@ -92,17 +156,98 @@ void FoldedMVOffload(const tiny_cnn::vec_t &in,
   }
 }
 
+shared_ptr<FoldedMVModel> FoldedMVPrepareModel(std::string dir) {
+  shared_ptr<FoldedMVModel> model = make_shared<FoldedMVModel>();
+  model->topology = loadTopology(dir);
+#ifdef SW_BACKEND
+  // a network of its own, filled and prepared off to the side
+  shared_ptr<SwNetwork> net = make_shared<SwNetwork>(model->topology);
+  FoldedMVReadParams(dir, model->topology,
+    [&](unsigned int targetLayer, unsigned int targetMem, const ExtMemWord * vals, unsigned int numWords) {
+      net->memSetBulk(targetLayer, targetMem, vals, numWords);
+    });
+  net->prepare();
+  model->net = net;
+#else
+  checkAccelerator(model->topology);
+  vector<vector<vector<ExtMemWord> > > & mems = model->mems;
+  mems.resize(2 * model->topology.layers.size());
+  FoldedMVReadParams(dir, model->topology,
+    [&](unsigned int targetLayer, unsigned int targetMem, const ExtMemWord * vals, unsigned int numWords) {
+      if(mems[targetLayer].size() <= targetMem)
+        mems[targetLayer].resize(targetMem + 1);
+      mems[targetLayer][targetMem].assign(vals, vals + numWords);
+    });
+#endif
+  return model;
+}
+
+shared_ptr<const NetworkTopology> FoldedMVActivateModel(const shared_ptr<FoldedMVModel> & model) {
+#ifdef SW_BACKEND
+  SwActivateNetwork(model->net);
+#else
+  for(unsigned int l = 0; l < model->mems.size(); l++)
+    for(unsigned int m = 0; m < model->mems[l].size(); m++)
+      FoldedMVMemSetBulk(l, m, model->mems[l][m].data(), model->mems[l][m].size());
+  atomic_store(&activeTopology(), shared_ptr<const NetworkTopology>(model, &model->topology));
+#endif
+  if(bufIn)
+    sizeHostBuffers();
+  return FoldedMVTopology();
+}
+
 void FoldedMVMemSet(unsigned int targetLayer, unsigned int targetMem, unsigned int targetInd, ExtMemWord val) {
   // call the accelerator in weight init mode
   kernelbnn((ap_uint<64> *)bufIn, (ap_uint<64> *)bufOut, true, targetLayer, targetMem, targetInd, val,0,0,0,0,0);
 }
 
-// TODO implement batch execution version
+void FoldedMVMemSetBulk(unsigned int targetLayer, unsigned int targetMem, const ExtMemWord * vals, unsigned int numWords) {
+#ifdef SW_BACKEND
+  // the software backend copies the whole image in one go
+  kernelbnnMemInit(targetLayer, targetMem, vals, numWords);
+#else
+  // the bitstream only has the single word init port of kernelbnn()
+  for(unsigned int i = 0; i < numWords; i++)
+    FoldedMVMemSet(targetLayer, targetMem, i, vals[i]);
+#endif
+}
+
+// batch execution: in holds numImages packed images back to back (inBufWords
+// words in total), they are streamed through the accelerator in a single call
+// so the weights stay resident for the whole batch; out receives outBufWords
+// words, split evenly between the images
 void FoldedMVOffloadBinarized(const ExtMemWord * in, ExtMemWord * out,
                               const unsigned int inBufWords, const unsigned int outBufWords, const unsigned int numImages) {
-
+  if(numImages == 0)
+    return;
+  if(inBufWords % numImages != 0 || outBufWords % numImages != 0)
+    throw "Buffer sizes are not a multiple of the number of images";
   // call the accelerator in compute mode
-  //kernelbnn((ap_uint<64> *)in, (ap_uint<64> *)out, false, 0, 0, 0, 0,numImages,inBufWords,outBufWords);
+  kernelbnn((ap_uint<64> *)in, (ap_uint<64> *)out, false, 0, 0, 0, 0, numImages,
+            inBufWords / numImages, outBufWords / numImages, 0, 0);
+}
+
+void FoldedMVOffloadAsync(const ExtMemWord * in, ExtMemWord * out,
+                          const unsigned int inBufWords, const unsigned int outBufWords, const unsigned int numImages) {
+  if(numImages == 0 || inBufWords % numImages != 0 || outBufWords % numImages != 0)
+    throw "Buffer sizes are not a multiple of the number of images";
+  kernelbnn((ap_uint<64> *)in, (ap_uint<64> *)out, false, 0, 0, 0, 0, numImages,
+            inBufWords / numImages, outBufWords / numImages, 1, 0);
 }
 
+void FoldedMVOffloadWait(const ExtMemWord * in, ExtMemWord * out,
+                         const unsigned int inBufWords, const unsigned int outBufWords, const unsigned int numImages) {
+  if(numImages == 0 || inBufWords % numImages != 0 || outBufWords % numImages != 0)
+    throw "Buffer sizes are not a multiple of the number of images";
+  kernelbnn((ap_uint<64> *)in, (ap_uint<64> *)out, false, 0, 0, 0, 0, numImages,
+            inBufWords / numImages, outBufWords / numImages, 0, 1);
+}
 
+bool FoldedMVOffloadPoll() {
+#ifdef SW_BACKEND
+  return kernelbnnTryWait() != 0;
+#else
+  // kernelbnn() queues its async calls on SDS queue 1
+  return sds_try_wait(1) != 0;
+#endif
+}
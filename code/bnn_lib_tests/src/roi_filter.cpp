@@ -17,7 +17,7 @@ Rect Roi_filter::basic_roi(const Mat& mat){
     Generate a bounding box on the contour found. 
     Add offset to ROI and snap to edges if neccessary. 
 
-    @param mat: Current Frame
+    @param mat: Current Frame (BGR or grey)
     :return: Rectangle indicating the ROI
 */
 
@@ -28,8 +28,12 @@ Rect Roi_filter::basic_roi(const Mat& mat){
 	int delta = 0;
 	int ddepth = CV_16S;
 
-    //Convert img to grey scale
-    cv::cvtColor(mat, grey_mat, CV_BGR2GRAY);
+    //Convert img to grey scale (the thumbnails from FramePrep are grey already)
+    if (mat.channels() == 1){
+        grey_mat = mat.clone();
+    } else {
+        cv::cvtColor(mat, grey_mat, CV_BGR2GRAY);
+    }
 
     //Blur img
     GaussianBlur(grey_mat, grey_mat, Size(3,3), 0, 0, BORDER_DEFAULT );
@@ -155,11 +159,15 @@ void Roi_filter::init_enhanced_roi(const Mat& img){
 	Optical Flow detection algorithms compares consecutive frames. 
     Hence, this func stores input image as prevous_mat, preparing for possible comparision for the next frame. 
 
-	@param mat: Current Frame
+	@param mat: Current Frame (BGR or grey)
 */
     cv::Mat grey_mat;
     prev_mat = img.clone();
-    cvtColor(img,grey_mat, COLOR_BGR2GRAY);
+    if (img.channels() == 1){
+        grey_mat = img;
+    } else {
+        cvtColor(img,grey_mat, COLOR_BGR2GRAY);
+    }
     prev_mat_grey = grey_mat.clone();
 }
 
@@ -168,11 +176,15 @@ Rect Roi_filter::enhanced_roi (const Mat& img){
 	Main wrapper function for using Optical Flow algorithms to generate ROI.
     Process: Optical Flow Algo to generate motion map -> Edge Detection on motion map -> Colour Similarity Check as Sanity Check
 
-	@param img: Current Frame
+	@param img: Current Frame (BGR or grey)
 */
     cv::Mat grey;
     cur_mat = img.clone();
-    cvtColor(img, grey, COLOR_BGR2GRAY);
+    if (img.channels() == 1){
+        grey = img;
+    } else {
+        cvtColor(img, grey, COLOR_BGR2GRAY);
+    }
     cur_mat_grey = grey.clone();
 
     cv::Mat contour_mat, motion_mat, weighted_mat;
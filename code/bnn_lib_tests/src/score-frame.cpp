@@ -0,0 +1,67 @@
+/******************************************************************************
+ *
+ *
+ * @file score-frame.cpp
+ *
+ * Output decoding, see score-frame.h.
+ *
+ *
+ *****************************************************************************/
+#include "score-frame.h"
+#include <math.h>
+#include <string.h>
+
+void ScoreFrame::decode(const uint16_t * out, unsigned int classes) {
+  if(classes == 0 || classes > scoreFrameMaxClasses)
+    throw "Unsupported number of classes";
+  this->classes = classes;
+  memcpy(scores, out, classes * sizeof(uint16_t));
+
+  // insertion into the short list of best classes, strictly greater scores
+  // only so that the earlier class wins a tie
+  topCount = classes < scoreFrameTopK ? classes : scoreFrameTopK;
+  unsigned int n = 0;
+  for(unsigned int c = 0; c < classes; c++) {
+    unsigned int i = n < topCount ? n++ : topCount;
+    while(i > 0 && scores[c] > scores[top[i - 1]]) {
+      if(i < topCount)
+        top[i] = top[i - 1];
+      i--;
+    }
+    if(i < topCount)
+      top[i] = c;
+  }
+  maxScore = scores[top[0]];
+  if(maxScore == 0) {
+    clear(classes);
+    return;
+  }
+
+  // softmax of x = score / maxScore; with ln(p) = x - ln(sum) the entropy
+  // needs a single logarithm
+  double sum = 0, weighted = 0;
+  for(unsigned int c = 0; c < classes; c++) {
+    prob[c] = exp((double)scores[c] / maxScore);
+    sum += prob[c];
+  }
+  for(unsigned int c = 0; c < classes; c++) {
+    prob[c] /= sum;
+    weighted += prob[c] * ((double)scores[c] / maxScore);
+  }
+  entropy = (log(sum) - weighted) / M_LN2;
+  margin = topCount > 1 ? prob[top[0]] - prob[top[1]] : 0;
+}
+
+void ScoreFrame::clear(unsigned int classes) {
+  if(classes == 0 || classes > scoreFrameMaxClasses)
+    throw "Unsupported number of classes";
+  this->classes = classes;
+  memset(scores, 0, classes * sizeof(uint16_t));
+  memset(prob, 0, classes * sizeof(double));
+  topCount = classes < scoreFrameTopK ? classes : scoreFrameTopK;
+  for(unsigned int i = 0; i < topCount; i++)
+    top[i] = i;
+  maxScore = 0;
+  margin = 0;
+  entropy = NAN;
+}
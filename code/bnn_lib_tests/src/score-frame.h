@@ -0,0 +1,46 @@
+/******************************************************************************
+ *
+ *
+ * @file score-frame.h
+ *
+ * Decoded output of one classification: the 16-bit class scores of the
+ * accelerator read once, with everything the filters derive from them
+ * (winning classes, softmax probabilities, entropy) computed in the same
+ * pass. Fixed size, so a frame can be decoded into the same object every
+ * time without allocating.
+ *
+ * The probabilities are the softmax of the scores divided by the highest
+ * one, as the window and uncertainty filters always normalised them. A
+ * frame whose scores are all zero (dropped or not processed) has all
+ * probabilities zero and an undefined (NaN) entropy.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+
+const unsigned int scoreFrameMaxClasses = 64;
+const unsigned int scoreFrameTopK = 5;
+
+struct ScoreFrame {
+  unsigned int classes;
+  uint16_t scores[scoreFrameMaxClasses];
+  double prob[scoreFrameMaxClasses];
+  // the min(classes, scoreFrameTopK) best classes, best first; of equal
+  // scores the lower class comes first, like max_element
+  unsigned int top[scoreFrameTopK];
+  unsigned int topCount;
+  unsigned int maxScore;
+  double margin;                // prob[top[0]] - prob[top[1]], 0 with one class
+  double entropy;               // of prob, in bits
+
+  ScoreFrame() : classes(0), topCount(0), maxScore(0), margin(0), entropy(0) {}
+
+  // decodes the first classes scores of an output buffer
+  void decode(const uint16_t * out, unsigned int classes);
+  // a frame without any score, for frames that were not classified
+  void clear(unsigned int classes);
+
+  unsigned int argmax() const { return top[0]; }
+  bool empty() const { return maxScore == 0; }
+};
@@ -0,0 +1,69 @@
+/******************************************************************************
+ *
+ *
+ * @file score-recorder.cpp
+ *
+ * Score trace recording for the experiment drivers, see score-recorder.h.
+ *
+ *
+ *****************************************************************************/
+#include "score-recorder.h"
+#include <chrono>
+#include <iostream>
+#include "opencv2/opencv.hpp"
+
+using namespace std;
+
+static uint32_t microseconds(chrono::high_resolution_clock::time_point from, chrono::high_resolution_clock::time_point to) {
+  return chrono::duration_cast<chrono::microseconds>(to - from).count();
+}
+
+void ScoreRecorder::record(const FrameStore & store, ScoreTrace & trace) {
+  cv::Mat input(32, 32, CV_8UC3);
+  ScoreFrame scores;
+  unique_ptr<FrameSource> dataset = store.stream();
+  for(Frame frame = dataset->grab(); frame; frame = dataset->grab()) {
+    ScoreTraceFrame t;
+    const auto t0 = chrono::high_resolution_clock::now();
+    // the drivers' capture and preprocessing sections, side by side
+    #pragma omp parallel sections
+    {
+      #pragma omp section
+      {
+        // the drivers' stand-in for a camera capture
+        cv::waitKey(6);
+        t.captureUs = microseconds(t0, chrono::high_resolution_clock::now());
+      }
+      #pragma omp section
+      {
+        const auto t1 = chrono::high_resolution_clock::now();
+        prep.loadFrame(frame);
+        prep.resize(input);
+        encoder.encode(input, packedImages, psi);
+        t.prepUs = microseconds(t1, chrono::high_resolution_clock::now());
+      }
+    }
+    const auto t2 = chrono::high_resolution_clock::now();
+    t.parallelUs = microseconds(t0, t2);
+    // synchronous, packedOut holds this frame's scores when it returns
+    kernelbnn((ap_uint<64> *)packedImages, (ap_uint<64> *)packedOut, false, 0, 0, 0, 0, 1, psi, pso, 0, 0);
+    scores.decode((const uint16_t *)packedOut, trace.key().classes);
+    t.bnnUs = microseconds(t2, chrono::high_resolution_clock::now());
+    trace.add(t, scores);
+  }
+}
+
+shared_ptr<ScoreTrace> ScoreRecorder::open(const string & file, const ScoreTraceKey & key, const FrameStore & store) {
+  shared_ptr<ScoreTrace> trace = openScoreTrace(file, key);
+  if(trace)
+    return trace;
+  cout << "Recording " << file << endl;
+  trace = make_shared<ScoreTrace>(key);
+  record(store, *trace);
+  try {
+    trace->save(file);
+  } catch(const char * e) {
+    cout << e << endl;
+  }
+  return trace;
+}
@@ -0,0 +1,45 @@
+/******************************************************************************
+ *
+ *
+ * @file score-recorder.h
+ *
+ * Records the score traces (see score-trace.h) replayed by the experiment
+ * drivers. Every frame of a dataset goes through the drivers' dataset
+ * capture, full-frame preprocessing and a synchronous BNN call, with no frame
+ * dropped, so that frame i of the trace holds the scores of frame i.
+ *
+ *   ScoreRecorder recorder(prep, encoder, packedImages, packedOut, psi, pso);
+ *   std::shared_ptr<ScoreTrace> trace = recorder.open(file, key, *store);
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <memory>
+#include <string>
+#include "foldedmv-offload.h"
+#include "frame-prep.h"
+#include "frame-store.h"
+#include "input-encoder.h"
+#include "score-trace.h"
+
+class ScoreRecorder {
+public:
+  // records through the driver's preprocessing and its accelerator buffers
+  // of psi input and pso output words
+  ScoreRecorder(FramePrep & prep, const InputEncoder & encoder, ExtMemWord * packedImages, ExtMemWord * packedOut,
+                unsigned int psi, unsigned int pso)
+    : prep(prep), encoder(encoder), packedImages(packedImages), packedOut(packedOut), psi(psi), pso(pso) {}
+
+  // appends every frame of store to trace
+  void record(const FrameStore & store, ScoreTrace & trace);
+  // the trace in file if it was recorded with key, else one recorded now and
+  // saved to file (kept in memory only if it cannot be saved)
+  std::shared_ptr<ScoreTrace> open(const std::string & file, const ScoreTraceKey & key, const FrameStore & store);
+
+private:
+  FramePrep & prep;
+  const InputEncoder & encoder;
+  ExtMemWord * const packedImages;
+  ExtMemWord * const packedOut;
+  const unsigned int psi, pso;
+};
@@ -0,0 +1,141 @@
+/******************************************************************************
+ *
+ *
+ * @file score-trace.cpp
+ *
+ * Storage and replay of score traces, see score-trace.h.
+ *
+ *
+ *****************************************************************************/
+#include "score-trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static uint64_t fnv1a(uint64_t h, const void * data, size_t n) {
+  const unsigned char * p = (const unsigned char *)data;
+  for(size_t i = 0; i < n; i++)
+    h = (h ^ p[i]) * 1099511628211ULL;
+  return h;
+}
+
+ScoreTraceKey scoreTraceKey(uint64_t dataset, uint64_t model, const string & roi, unsigned int classes, unsigned int clockMHz) {
+  ScoreTraceKey k;
+  memset(&k, 0, sizeof(k));
+  k.dataset = dataset;
+  k.model = model;
+  k.classes = classes;
+  k.clockMHz = clockMHz;
+  roi.copy(k.roi, sizeof(k.roi) - 1);
+  return k;
+}
+
+uint64_t paramsFingerprint(const string & dir) {
+  DIR * d = opendir(dir.c_str());
+  if(!d)
+    throw "Could not open parameter directory";
+  vector<string> names;
+  while(struct dirent * e = readdir(d))
+    if(e->d_name[0] != '.')
+      names.push_back(e->d_name);
+  closedir(d);
+  // readdir order is arbitrary
+  sort(names.begin(), names.end());
+  uint64_t h = 14695981039346656037ULL;
+  for(size_t i = 0; i < names.size(); i++) {
+    struct stat st;
+    if(stat((dir + "/" + names[i]).c_str(), &st) != 0)
+      continue;
+    const int64_t stamp[2] = {(int64_t)st.st_size, (int64_t)st.st_mtime};
+    h = fnv1a(h, names[i].data(), names[i].size());
+    h = fnv1a(h, stamp, sizeof(stamp));
+  }
+  return h;
+}
+
+ScoreTrace::ScoreTrace(const ScoreTraceKey & key) : traceKey(key) {
+  if(key.classes == 0 || key.classes > scoreFrameMaxClasses)
+    throw "Unsupported number of classes";
+}
+
+ScoreTrace::ScoreTrace(const string & file) {
+  ifstream in(file, ios::binary | ios::in);
+  if(!in.is_open())
+    throw "Could not open score trace";
+  ScoreTraceHeader h;
+  if(!in.read((char *)&h, sizeof(h)))
+    throw "Score trace truncated";
+  if(memcmp(h.magic, scoreTraceMagic, sizeof(h.magic)) != 0)
+    throw "Not a score trace";
+  if(h.version != scoreTraceVersion)
+    throw "Unsupported score trace version";
+  if(h.key.classes == 0 || h.key.classes > scoreFrameMaxClasses)
+    throw "Unsupported number of classes";
+  traceKey = h.key;
+  timing.resize(h.numFrames);
+  score.resize((size_t)h.numFrames * h.key.classes);
+  in.read((char *)timing.data(), timing.size() * sizeof(ScoreTraceFrame));
+  in.read((char *)score.data(), score.size() * sizeof(uint16_t));
+  if(!in)
+    throw "Score trace truncated";
+}
+
+void ScoreTrace::add(const ScoreTraceFrame & times, const ScoreFrame & scores) {
+  if(scores.classes != traceKey.classes)
+    throw "Score trace of another number of classes";
+  timing.push_back(times);
+  score.insert(score.end(), scores.scores, scores.scores + traceKey.classes);
+}
+
+ScoreTraceReplay ScoreTrace::replay(unsigned int i, bool processed) const {
+  const ScoreTraceFrame & t = timing[i];
+  ScoreTraceReplay r;
+  r.captureUs = t.captureUs;
+  r.prepUs = processed ? t.prepUs : 0;
+  r.elapsedUs = processed ? t.parallelUs + t.bnnUs : t.captureUs;
+  return r;
+}
+
+void ScoreTrace::scores(unsigned int i, ScoreFrame & scores) const {
+  scores.decode(&score[(size_t)i * traceKey.classes], traceKey.classes);
+}
+
+void ScoreTrace::save(const string & file) const {
+  const string tmpFile = file + ".tmp";
+  ofstream out(tmpFile, ios::binary | ios::out | ios::trunc);
+  if(!out.is_open())
+    throw "Could not create score trace";
+  ScoreTraceHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, scoreTraceMagic, sizeof(h.magic));
+  h.version = scoreTraceVersion;
+  h.numFrames = timing.size();
+  h.key = traceKey;
+  out.write((const char *)&h, sizeof(h));
+  out.write((const char *)timing.data(), timing.size() * sizeof(ScoreTraceFrame));
+  out.write((const char *)score.data(), score.size() * sizeof(uint16_t));
+  out.close();
+  if(!out || rename(tmpFile.c_str(), file.c_str()) != 0) {
+    unlink(tmpFile.c_str());
+    throw "Could not write score trace";
+  }
+}
+
+shared_ptr<ScoreTrace> openScoreTrace(const string & file, const ScoreTraceKey & key) {
+  if(access(file.c_str(), R_OK) != 0)
+    return nullptr;
+  try {
+    shared_ptr<ScoreTrace> trace = make_shared<ScoreTrace>(file);
+    if(memcmp(&trace->key(), &key, sizeof(key)) == 0)
+      return trace;
+  } catch(const char *) {
+    // recorded again by the caller
+  }
+  return nullptr;
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+ *
+ *
+ * @file score-trace.h
+ *
+ * Class scores and stage timings of every frame of a dataset, recorded once
+ * and replayed by the experiment drivers. With the full frame as ROI the BNN
+ * scores of a frame do not depend on the window or uncertainty filter being
+ * swept, so every configuration after the first one drives the filters from
+ * the trace instead of resizing, packing and classifying the frames again.
+ *
+ * Layout (little endian):
+ *
+ *   ScoreTraceHeader
+ *   ScoreTraceFrame[numFrames]        timings
+ *   uint16_t[numFrames][classes]      scores, as read from the accelerator
+ *
+ * The header holds the key the trace was recorded with (dataset, parameters,
+ * ROI mode, clock); a trace of another key is recorded again. Traces are
+ * recorded by ScoreRecorder, see score-recorder.h.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "score-frame.h"
+
+const char scoreTraceMagic[8] = {'B', 'N', 'N', 'T', 'R', 'A', 'C', 0};
+// 2: scores of synchronous BNN calls, version 1 traces could hold the
+// previous frame's
+const uint32_t scoreTraceVersion = 2;
+
+struct ScoreTraceKey {
+  uint64_t dataset;             // FrameStore::fingerprint() of the frames
+  uint64_t model;               // paramsFingerprint() of the network
+  uint32_t classes;
+  uint32_t clockMHz;            // PL clock the timings were taken at
+  char roi[16];                 // ROI mode, zero padded
+};
+
+struct ScoreTraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t numFrames;
+  ScoreTraceKey key;
+};
+
+// microseconds spent on a frame by each stage, as the drivers time them
+struct ScoreTraceFrame {
+  uint32_t captureUs;
+  uint32_t prepUs;              // ROI, resize and packing
+  uint32_t parallelUs;          // capture and preparation, run side by side
+  uint32_t bnnUs;
+};
+
+// a recorded frame as a driver replaying it accounts it
+struct ScoreTraceReplay {
+  uint32_t captureUs;
+  uint32_t prepUs;              // 0 for a dropped frame
+  uint32_t elapsedUs;           // parallelUs + bnnUs, only captureUs for a dropped frame
+};
+
+// key of the given dataset and parameters, roi truncated to 15 characters
+ScoreTraceKey scoreTraceKey(uint64_t dataset, uint64_t model, const std::string & roi, unsigned int classes, unsigned int clockMHz);
+// 64-bit FNV-1a of the names, sizes and modification times of the files in
+// the parameter directory dir
+uint64_t paramsFingerprint(const std::string & dir);
+
+class ScoreTrace {
+public:
+  // an empty trace, to record into
+  explicit ScoreTrace(const ScoreTraceKey & key);
+  // loads a trace, throws if the file is missing, truncated or of another
+  // version
+  explicit ScoreTrace(const std::string & file);
+
+  const ScoreTraceKey & key() const { return traceKey; }
+  unsigned int frames() const { return timing.size(); }
+  // appends the next frame
+  void add(const ScoreTraceFrame & times, const ScoreFrame & scores);
+  const ScoreTraceFrame & times(unsigned int i) const { return timing[i]; }
+  // the timings of frame i, processed or dropped by the driver
+  ScoreTraceReplay replay(unsigned int i, bool processed) const;
+  // decodes the recorded scores of frame i into scores
+  void scores(unsigned int i, ScoreFrame & scores) const;
+  // writes the trace, through a temporary file so that an interrupted
+  // recording never leaves a partial trace
+  void save(const std::string & file) const;
+
+private:
+  ScoreTraceKey traceKey;
+  std::vector<ScoreTraceFrame> timing;
+  std::vector<uint16_t> score;  // classes per frame
+};
+
+// the trace in file if it was recorded with key, null if it is missing, was
+// recorded with another key or is unreadable
+std::shared_ptr<ScoreTrace> openScoreTrace(const std::string & file, const ScoreTraceKey & key);
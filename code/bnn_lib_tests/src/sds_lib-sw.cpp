@@ -0,0 +1,298 @@
+/******************************************************************************
+ *
+ *
+ * @file sds_lib-sw.cpp
+ *
+ * Host stand-in for the parts of the SDSoC runtime (sds_lib.h) used by the
+ * host code, linked instead of the board runtime when building with the
+ * software backend ("make BACKEND=sw"). Besides the buffer and clock
+ * functions it emulates the accelerator's request queues with a worker
+ * thread, see sds_lib-sw.h.
+ *
+ *
+ *****************************************************************************/
+#include "sds_lib.h"
+#include "sds_lib-sw.h"
+#include <stdlib.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sys/mman.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#include <cpuid.h>
+#define SDS_X86_TSC
+#endif
+
+using namespace std;
+
+// buffers of this size and up are mapped, backed by huge pages if possible
+static const size_t hugePageBytes = 2 << 20;
+
+// mapped buffers and their size, everything else came from posix_memalign
+static mutex mappedLock;
+static map<void *, size_t> mapped;
+
+// small buffers are cache line aligned, there is no DMA engine so
+// contiguity does not matter; large ones get huge pages to save TLB misses
+void *sds_alloc(unsigned int size) {
+  if(size >= hugePageBytes) {
+    const size_t bytes = (size + hugePageBytes - 1) / hugePageBytes * hugePageBytes;
+    void * p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    p = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if(p == MAP_FAILED) {
+      // no reserved huge pages, ask for transparent ones instead
+      p = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+      if(p != MAP_FAILED)
+        madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    }
+    if(p != MAP_FAILED) {
+      lock_guard<mutex> g(mappedLock);
+      mapped[p] = bytes;
+      return p;
+    }
+  }
+  void * p = 0;
+  if(posix_memalign(&p, 64, size) != 0)
+    return 0;
+  return p;
+}
+
+void *sds_alloc_cacheable(unsigned int size) {
+  return sds_alloc(size);
+}
+
+void *sds_alloc_non_cacheable(unsigned int size) {
+  return sds_alloc(size);
+}
+
+void sds_free(void *memptr) {
+  {
+    lock_guard<mutex> g(mappedLock);
+    map<void *, size_t>::iterator it = mapped.find(memptr);
+    if(it != mapped.end()) {
+      munmap(it->first, it->second);
+      mapped.erase(it);
+      return;
+    }
+  }
+  free(memptr);
+}
+
+// The emulated accelerator: one worker thread running the jobs in order.
+// Each job leaves a completion record in the queue of its SDS id, which
+// sds_wait()/sds_try_wait() take off again.
+namespace {
+struct Request {
+  bool done;
+  exception_ptr error;
+};
+
+class Accelerator {
+public:
+  Accelerator() : stop(false), outstanding(0), worker(&Accelerator::run, this) {}
+
+  ~Accelerator() {
+    {
+      lock_guard<mutex> g(lock);
+      stop = true;
+    }
+    wake.notify_all();
+    worker.join();
+  }
+
+  void submit(unsigned int id, const function<void()> & job) {
+    shared_ptr<Request> r = make_shared<Request>();
+    r->done = false;
+    {
+      lock_guard<mutex> g(lock);
+      jobs.push_back(make_pair(r, job));
+      queues[id].push_back(r);
+      outstanding++;
+    }
+    wake.notify_all();
+  }
+
+  void wait(unsigned int id) {
+    unique_lock<mutex> g(lock);
+    deque<shared_ptr<Request> > & q = queues[id];
+    if(q.empty())
+      return;
+    shared_ptr<Request> r = q.front();
+    q.pop_front();
+    finished.wait(g, [&] { return r->done; });
+    if(r->error)
+      rethrow_exception(r->error);
+  }
+
+  int tryWait(unsigned int id) {
+    lock_guard<mutex> g(lock);
+    deque<shared_ptr<Request> > & q = queues[id];
+    if(q.empty())
+      return 1;
+    if(!q.front()->done)
+      return 0;
+    shared_ptr<Request> r = q.front();
+    q.pop_front();
+    if(r->error)
+      rethrow_exception(r->error);
+    return 1;
+  }
+
+  void idle() {
+    unique_lock<mutex> g(lock);
+    finished.wait(g, [&] { return outstanding == 0; });
+  }
+
+  bool busy() {
+    lock_guard<mutex> g(lock);
+    return outstanding != 0;
+  }
+
+private:
+  void run() {
+    unique_lock<mutex> g(lock);
+    for(;;) {
+      wake.wait(g, [&] { return stop || !jobs.empty(); });
+      if(jobs.empty())
+        return;
+      pair<shared_ptr<Request>, function<void()> > j = jobs.front();
+      jobs.pop_front();
+      g.unlock();
+      exception_ptr error;
+      try {
+        j.second();
+      } catch(...) {
+        error = current_exception();
+      }
+      g.lock();
+      j.first->error = error;
+      j.first->done = true;
+      outstanding--;
+      finished.notify_all();
+    }
+  }
+
+  mutex lock;
+  condition_variable wake, finished;
+  bool stop;
+  unsigned int outstanding;     // submitted jobs that have not run yet
+  deque<pair<shared_ptr<Request>, function<void()> > > jobs;
+  map<unsigned int, deque<shared_ptr<Request> > > queues;
+  thread worker;
+};
+
+Accelerator & accelerator() {
+  static Accelerator acc;
+  return acc;
+}
+}
+
+void sdsSwSubmit(unsigned int id, const function<void()> & job) {
+  accelerator().submit(id, job);
+}
+
+void sdsSwIdle() {
+  accelerator().idle();
+}
+
+bool sdsSwBusy() {
+  return accelerator().busy();
+}
+
+void sds_wait(unsigned int id) {
+  accelerator().wait(id);
+}
+
+int sds_try_wait(unsigned int id) {
+  return accelerator().tryWait(id);
+}
+
+// Free running counter: the invariant TSC on x86, the generic timer on
+// ARMv8, and nanoseconds of the monotonic clock elsewhere.
+namespace {
+struct Counter {
+  unsigned long long (*read)();
+  unsigned long long frequency;
+  long long offset;             // added to the raw count, see sds_set_counter
+};
+
+unsigned long long readSteady() {
+  return chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef SDS_X86_TSC
+unsigned long long readTsc() {
+  return __rdtsc();
+}
+
+bool invariantTsc() {
+  unsigned int a, b, c, d;
+  if(!__get_cpuid(0x80000000, &a, &b, &c, &d) || a < 0x80000007)
+    return false;
+  __get_cpuid(0x80000007, &a, &b, &c, &d);
+  return (d >> 8) & 1;
+}
+#endif
+
+#ifdef __aarch64__
+unsigned long long readCntvct() {
+  unsigned long long v;
+  __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+}
+#endif
+
+Counter makeCounter() {
+  Counter c = { readSteady, 1000000000ULL, 0 };
+#ifdef SDS_X86_TSC
+  if(invariantTsc()) {
+    // the TSC rate is not architecturally visible, measure it against the
+    // monotonic clock
+    const unsigned long long s0 = readSteady(), t0 = readTsc();
+    this_thread::sleep_for(chrono::milliseconds(20));
+    const unsigned long long s1 = readSteady(), t1 = readTsc();
+    c.read = readTsc;
+    c.frequency = (unsigned long long)((double)(t1 - t0) * 1e9 / (double)(s1 - s0));
+  }
+#endif
+#ifdef __aarch64__
+  unsigned long long f;
+  __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(f));
+  if(f) {
+    c.read = readCntvct;
+    c.frequency = f;
+  }
+#endif
+  return c;
+}
+
+Counter & counter() {
+  static Counter c = makeCounter();
+  return c;
+}
+}
+
+unsigned long long sds_clock_counter(void) {
+  Counter & c = counter();
+  return c.read() + c.offset;
+}
+
+unsigned long long sds_clock_frequency(void) {
+  return counter().frequency;
+}
+
+void sds_set_counter(unsigned long long val) {
+  Counter & c = counter();
+  c.offset = (long long)(val - c.read());
+}
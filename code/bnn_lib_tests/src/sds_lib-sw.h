@@ -0,0 +1,23 @@
+/******************************************************************************
+ *
+ *
+ * @file sds_lib-sw.h
+ *
+ * Extensions of the host stand-in for the SDSoC runtime (sds_lib-sw.cpp)
+ * used by the software kernelbnn(). The stand-in emulates the accelerator by
+ * a worker thread: jobs submitted to it run one after the other in
+ * submission order, and as with an SDS async(id) call on the board
+ * sds_wait(id) / sds_try_wait(id) retire the jobs queued under id oldest
+ * first.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <functional>
+
+// queues job on the emulated accelerator under SDS queue id
+void sdsSwSubmit(unsigned int id, const std::function<void()> & job);
+// waits until every job queued so far has run, without retiring any
+void sdsSwIdle();
+// true while queued jobs have not run yet
+bool sdsSwBusy();
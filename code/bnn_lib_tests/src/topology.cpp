@@ -0,0 +1,128 @@
+/******************************************************************************
+ *
+ *
+ * @file topology.cpp
+ *
+ * Parser for the topology.txt network descriptors. The format is line based,
+ * '#' starts a comment:
+ *
+ *   network <name>
+ *   classes <count>
+ *   layer <type> <k> <ifm_ch> <ifm_dim> <ofm_ch> <ofm_dim> <pool> <simd> <pe> <wmem> <tmem>
+ *
+ * with <type> one of fxdconv, conv, fc, fc_noact and one layer line per
+ * layer in execution order.
+ *
+ *
+ *****************************************************************************/
+#include "topology.h"
+#include "config.h"
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+static const unsigned int wordBits = 64;
+
+static unsigned int wordsFor(unsigned int bits) {
+  return (bits + wordBits - 1) / wordBits;
+}
+
+unsigned int NetworkTopology::inWords() const {
+  const LayerTopology & l = layers.front();
+  // the fixed point layer takes 8-bit pixels, the binarized layers one bit
+  // per channel with every pixel padded to whole words
+  if(l.kind == LAYER_FXDCONV)
+    return wordsFor(l.ifmDim * l.ifmDim * l.ifmCh * 8);
+  return l.ifmDim * l.ifmDim * wordsFor(l.ifmCh);
+}
+
+unsigned int NetworkTopology::outWords() const {
+  const LayerTopology & l = layers.back();
+  if(l.kind == LAYER_FC_NOACT)
+    return wordsFor(l.ofmCh * 16);
+  const unsigned int dim = l.pool ? l.ofmDim / 2 : l.ofmDim;
+  return dim * dim * wordsFor(l.ofmCh);
+}
+
+static LayerKind parseKind(const string & s) {
+  if(s == "fxdconv")
+    return LAYER_FXDCONV;
+  if(s == "conv")
+    return LAYER_CONV;
+  if(s == "fc")
+    return LAYER_FC;
+  if(s == "fc_noact")
+    return LAYER_FC_NOACT;
+  throw "Unknown layer type in topology descriptor";
+}
+
+NetworkTopology loadTopology(const string & paramsDir) {
+  ifstream f(paramsDir + "/topology.txt");
+  if(!f.is_open())
+    throw "Could not open topology descriptor";
+  NetworkTopology t;
+  t.classes = 0;
+  string line;
+  while(getline(f, line)) {
+    line = line.substr(0, line.find('#'));
+    istringstream ls(line);
+    string key;
+    if(!(ls >> key))
+      continue;
+    if(key == "network") {
+      ls >> t.name;
+    } else if(key == "classes") {
+      ls >> t.classes;
+    } else if(key == "layer") {
+      LayerTopology l;
+      string kind;
+      unsigned int pool;
+      if(!(ls >> kind >> l.k >> l.ifmCh >> l.ifmDim >> l.ofmCh >> l.ofmDim >> pool >> l.simd >> l.pe >> l.wmem >> l.tmem))
+        throw "Malformed layer in topology descriptor";
+      l.kind = parseKind(kind);
+      l.pool = pool != 0;
+      if(l.simd == 0 || l.pe == 0 || (l.k * l.k * l.ifmCh) % l.simd != 0)
+        throw "Invalid folding in topology descriptor";
+      t.layers.push_back(l);
+    } else {
+      throw "Unknown key in topology descriptor";
+    }
+  }
+  if(t.layers.empty() || t.layers.back().kind != LAYER_FC_NOACT)
+    throw "Topology descriptor must end with an fc_noact layer";
+  if(t.classes == 0 || t.classes > t.layers.back().ofmCh)
+    throw "Invalid class count in topology descriptor";
+
+  ifstream cf(paramsDir + "/classes.txt");
+  while(getline(cf, line) && t.classNames.size() < t.classes) {
+    if(!line.empty() && line[line.size() - 1] == '\r')
+      line.erase(line.size() - 1);
+    t.classNames.push_back(line);
+  }
+  return t;
+}
+
+static void addLayer(NetworkTopology & t, LayerKind kind, unsigned int k, unsigned int ifmCh, unsigned int ifmDim,
+                     unsigned int ofmCh, unsigned int ofmDim, bool pool,
+                     unsigned int simd, unsigned int pe, unsigned int wmem, unsigned int tmem) {
+  LayerTopology l = {kind, k, ifmCh, ifmDim, ofmCh, ofmDim, pool, simd, pe, wmem, tmem};
+  t.layers.push_back(l);
+}
+
+NetworkTopology defaultTopology() {
+  NetworkTopology t;
+  t.name = "cifar10";
+  t.classes = 10;
+  t.classNames = {"airplane", "automobile", "bird", "cat", "deer", "dog", "frog", "horse", "ship", "truck"};
+  addLayer(t, LAYER_FXDCONV, L0_K, L0_IFM_CH, L0_IFM_DIM, L0_OFM_CH, L0_OFM_DIM, false, L0_SIMD, L0_PE, L0_WMEM, L0_TMEM);
+  addLayer(t, LAYER_CONV, L1_K, L1_IFM_CH, L1_IFM_DIM, L1_OFM_CH, L1_OFM_DIM, true, L1_SIMD, L1_PE, L1_WMEM, L1_TMEM);
+  addLayer(t, LAYER_CONV, L2_K, L2_IFM_CH, L2_IFM_DIM, L2_OFM_CH, L2_OFM_DIM, false, L2_SIMD, L2_PE, L2_WMEM, L2_TMEM);
+  addLayer(t, LAYER_CONV, L3_K, L3_IFM_CH, L3_IFM_DIM, L3_OFM_CH, L3_OFM_DIM, true, L3_SIMD, L3_PE, L3_WMEM, L3_TMEM);
+  addLayer(t, LAYER_CONV, L4_K, L4_IFM_CH, L4_IFM_DIM, L4_OFM_CH, L4_OFM_DIM, false, L4_SIMD, L4_PE, L4_WMEM, L4_TMEM);
+  addLayer(t, LAYER_CONV, L5_K, L5_IFM_CH, L5_IFM_DIM, L5_OFM_CH, L5_OFM_DIM, false, L5_SIMD, L5_PE, L5_WMEM, L5_TMEM);
+  addLayer(t, LAYER_FC, 1, L6_MW, 1, L6_MH, 1, false, L6_SIMD, L6_PE, L6_WMEM, L6_TMEM);
+  addLayer(t, LAYER_FC, 1, L7_MW, 1, L7_MH, 1, false, L7_SIMD, L7_PE, L7_WMEM, L7_TMEM);
+  addLayer(t, LAYER_FC_NOACT, 1, L8_MW, 1, L8_MH, 1, false, L8_SIMD, L8_PE, L8_WMEM, L8_TMEM);
+  return t;
+}
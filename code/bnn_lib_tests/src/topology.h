@@ -0,0 +1,48 @@
+/******************************************************************************
+ *
+ *
+ * @file topology.h
+ *
+ * Runtime description of a FINN network: layer shapes and folding factors
+ * (PE-SIMD, weight/threshold memory depths) as read from the topology.txt
+ * descriptor stored next to the parameter files of each network, so that
+ * one build can load any of the networks in params/.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <string>
+#include <vector>
+
+// kinds of layer, mirroring the streaming components of the FINN hardware
+enum LayerKind {
+  LAYER_FXDCONV,   // fixed point input, binary weights, thresholded (first CNV layer)
+  LAYER_CONV,      // binarized convolution, thresholded
+  LAYER_FC,        // binarized fully connected, thresholded
+  LAYER_FC_NOACT   // binarized fully connected, raw 16-bit popcount output (last layer)
+};
+
+struct LayerTopology {
+  LayerKind kind;
+  // fully connected layers are described as 1x1 convolutions on a 1x1 map
+  unsigned int k, ifmCh, ifmDim, ofmCh, ofmDim;
+  bool pool;                    // followed by a 2x2 max pool
+  unsigned int simd, pe, wmem, tmem;
+};
+
+struct NetworkTopology {
+  std::string name;
+  unsigned int classes;
+  std::vector<std::string> classNames;
+  std::vector<LayerTopology> layers;
+
+  // ExtMemWords per input image and per output
+  unsigned int inWords() const;
+  unsigned int outWords() const;
+};
+
+// reads <paramsDir>/topology.txt and, if present, <paramsDir>/classes.txt
+NetworkTopology loadTopology(const std::string & paramsDir);
+
+// the CNV network described by config.h
+NetworkTopology defaultTopology();
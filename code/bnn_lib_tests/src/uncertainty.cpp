@@ -11,12 +11,12 @@
 //--------------------------------------------------------------Main Wrapper Function-------------------------------------------------------------------
 //------------------------------------------------------------------------------------------------------------------------------------------------------
 
-std::vector<double> Uncertainty::cal_uncertainty(std::vector<float> class_result, string mode, int result){
+std::vector<double> Uncertainty::cal_uncertainty(const ScoreFrame &scores, string mode, int result){
 /*
 	Main wrapper function in uncertainty filter.
     "uncertainty_score" is the uncertainty score calculated from Entropy/Variance/AutoCorrelation
 
-    @param class_result: an array containing the 10 class scores (current output from BNN)
+    @param scores: the decoded class scores (current output from BNN), with their softmax probabilities and entropy
     @param mode: "en/var/a" determines which uncertainty calculation schemes to be used
     @param result: raw output = Position of max element in the current class_result array
 	:return {uncertainty_score, ma, __sd_of_uncertainty_score_running_mean, cur_state, cur_mode}: uncertainty_score, moving average of uncertainty_score, standard deviation of uncertainty_score, current state, current mode
@@ -30,21 +30,26 @@ std::vector<double> Uncertainty::cal_uncertainty(std::vector<float> class_result
     srand(11); //set random seed for constant exp. result
     //when not using the uncertainty analysis at all
 
-    std::vector<double> input_v(class_result.begin(), class_result.end());
     double uncertainty_score_runningmean = 0;
 
     double old_uncertainty_score_runningmean = __uncertainty_score_running_mean;
     double old_sd_of_uncertainty_score_running_mean = __sd_of_uncertainty_score_running_mean;
 
     double uncertainty_score; // correlation or varience or cal_entropy of the input
-    std::vector<double> pmf = softmax(input_v);
+    // predictive probabilities, undefined when all scores are zero
+    double undefined_pmf[scoreFrameMaxClasses];
+    const double *pmf = scores.prob;
+    if (scores.empty()){
+        std::fill(undefined_pmf, undefined_pmf + scores.classes, NAN);
+        pmf = undefined_pmf;
+    }
 
     if (mode == "var"){
-        uncertainty_score = cal_variance(pmf, 10)[2];
+        uncertainty_score = cal_variance(pmf, scores.classes)[2];
     } else if (mode == "en"){
-        uncertainty_score = cal_entropy(pmf);
+        uncertainty_score = scores.entropy;
     } else if (mode == "a"){
-        uncertainty_score = cal_autocorr(pmf, result);
+        uncertainty_score = cal_autocorr(pmf, scores.classes, result);
     }
 
     if (std::isnan(uncertainty_score)){
@@ -100,7 +105,7 @@ std::vector<double> Uncertainty::cal_uncertainty(std::vector<float> class_result
         //cout << "----------initialising stage 4---------" << endl;
         vector <double> r;
         
-        r = cal_variance(__uncertainty_score_runningmean_buf, __lambda);
+        r = cal_variance(__uncertainty_score_runningmean_buf.data(), __lambda);
         __mean_of_uncertainty_score_runningmean = r[0];
         __aggrM = r[1];
 
@@ -143,27 +148,12 @@ std::vector<double> Uncertainty::cal_uncertainty(std::vector<float> class_result
 //--------------------------------------------------------------Method 1: Entropy-----------------------------------------------------------------------
 //------------------------------------------------------------------------------------------------------------------------------------------------------
 
-double Uncertainty::cal_entropy(std::vector<double> &arg_vec)
-{
-/*
-	Entropy Calculation
-
-    @param arg_vec: an array containing the 10 class scores (current output from BNN)
-	:return sum: an integer representing the entropy of the class_scores array
-*/
-    double sum = 0;
-    for(auto const &elem : arg_vec){
-        sum += elem * std::log2(1/elem);
-    }
-    return sum;
-}
-
 
 //------------------------------------------------------------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------Method 2: Variance----------------------------------------------------------------------
 //------------------------------------------------------------------------------------------------------------------------------------------------------
 
-vector<double> Uncertainty::cal_variance(vector<double> &ma, int n){
+vector<double> Uncertainty::cal_variance(const double *ma, int n){
 /*
 	Variance Calculation
 
@@ -172,15 +162,15 @@ vector<double> Uncertainty::cal_variance(vector<double> &ma, int n){
 	:return {mean_of_ma, aggrM, (sum/(n-1))}: mean, aggregated square sum in variance equation, variance
 */
     double m = 0;
-    for(auto const &elem : ma){
+    for(int i = 0; i < n; i++){
         //sum += pow((elem-mean),2);
-        m += elem;
+        m += ma[i];
     }
     double mean_of_ma = m/n;
 
     double sum = 0;
-    for(auto const &elem : ma){
-        sum += pow((elem - mean_of_ma ),2);
+    for(int i = 0; i < n; i++){
+        sum += pow((ma[i] - mean_of_ma ),2);
     }
     double aggrM = sum;
     //cout << "INIT_VAR: updating mean_of_ma and aggrM " << mean_of_ma << " " << aggrM <<endl;
@@ -191,13 +181,14 @@ vector<double> Uncertainty::cal_variance(vector<double> &ma, int n){
 //------------------------------------------------------------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------Method 3: Auto Correlation--------------------------------------------------------------
 //------------------------------------------------------------------------------------------------------------------------------------------------------
-double Uncertainty::cal_autocorr(std::vector<double> &arg_vec, int result){
+double Uncertainty::cal_autocorr(const double *arg_vec, int n_classes, int result){
 /*
 	Wrapper for Autocorrelation Schemes
 
     __running_corr = {class1 autocorr result, class2 autocorr result ...}
 
     @param arg_vec: current class_scores array
+    @param n_classes: number of elements in arg_vec
     @param result: raw classification result (Index of max element in class_scores array)
 	:return: an integer representing the uncertainty scores from Autocorrelation scheme
 */
@@ -209,7 +200,7 @@ double Uncertainty::cal_autocorr(std::vector<double> &arg_vec, int result){
         return -1.0;
     }
 
-    insert_corr_history(arg_vec); //Store class_score into __corr_history
+    insert_corr_history(arg_vec, n_classes); //Store class_score into __corr_history
     int num_of_stored_result = __corr_history[0].size(); //Check how many class_score array were stored
     //cout << "num_of_stored_result: " << num_of_stored_result << endl;
 
@@ -245,14 +236,13 @@ double Uncertainty::cal_autocorr(std::vector<double> &arg_vec, int result){
     return __running_corr[result];
 }
 
-int Uncertainty::insert_corr_history(std::vector<double> &arg_vec){
+int Uncertainty::insert_corr_history(const double *arg_vec, int s){
 /*
 	Store class_scores arrays (prepare for autocorrelation calculation)
 
     @param arg_vec: input array
+    @param s: number of elements in arg_vec
 */
-    int s = arg_vec.size();
-
     for (int i = 0 ; i < s ; i++){
         double elem = arg_vec[i];
         if (elem != elem){return -1;}//check isnan
@@ -323,46 +313,6 @@ double Uncertainty::naive_mean(std::vector<double> &arg_vec, int n){
     return __uncertainty_score_running_mean;
 }
 
-std::vector<double> Uncertainty::normalise(std::vector<double> &cp){
-/*
-	Normalised the input array
-
-    @param cp: input array
-    :return cp: normalised input array
-*/
-    double mx = *max_element(std::begin(cp), std::end(cp));
-    
-    for(auto &elem : cp)
-        elem = (double)elem / mx;
-    
-    return cp;
-}
-
-std::vector<double> Uncertainty::softmax(std::vector<double> &arg_vec){
-/*
-	Apply softmax function to the input array
-
-    @param arg_vec: input array
-    :return norm_vec: output array containing predictive probabilities
-*/
-    // Normalise the vector
-    std::vector<double> norm_vec = normalise(arg_vec);
-    float mx = *max_element(std::begin(norm_vec), std::end(norm_vec));
-    float sum = 0;
-    for(auto const &elem : norm_vec)
-        sum += exp(elem);
-    
-    if(sum == 0){
-        std::cout << "Division by zero, sum = 0" << std::endl;
-    }
-    for(int i=0; i<10;i++)
-    {
-        norm_vec[i] = exp(norm_vec[i]) / sum;
-    }
-
-    return norm_vec;
-}
-
 void Uncertainty::insert_buf(std::vector<double> &arg_vec, double &elem){
 /*
 	Insert an element into an array
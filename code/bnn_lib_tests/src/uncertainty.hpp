@@ -13,6 +13,7 @@
 #include <vector>
 #include <algorithm>
 #include <iterator>
+#include "score-frame.h"
 
 using namespace std;
 
@@ -36,18 +37,15 @@ class Uncertainty{
         std::vector<double> __running_corr;
 
         //Calculate Variance, Entropy, AutoCorrelation
-        double cal_entropy(std::vector<double> &arg_vec);
-        vector<double> cal_variance(vector<double> &ma, int n);
+        vector<double> cal_variance(const double *ma, int n);
         vector<double> running_var(vector<double> ma, int n, double mean_of_ma, double arg_aggrM);
-        double cal_autocorr(std::vector<double> &arg_vec, int result);
-        int insert_corr_history(std::vector<double> &arg_vec);
+        double cal_autocorr(const double *arg_vec, int n, int result);
+        int insert_corr_history(const double *arg_vec, int n);
         void constraint_corr_history(int n);
         double running_autocorr(std::vector<double> &arg_vec, double old_corr);
         double running_autocorr_init(std::vector<double> &arg_vec);
 
 
-        std::vector<double> normalise(std::vector<double> &cp);
-        std::vector<double> softmax(std::vector<double> &arg_vec);
         void insert_buf(std::vector<double> &arg_vec, double &elem);
         void constraint_buf(std::vector<double> &arg_vec);
         double running_mean_init(double &elem);
@@ -78,7 +76,7 @@ class Uncertainty{
             __corr_init = false;
         }
 
-        std::vector<double> cal_uncertainty(std::vector<float> class_result, string mode, int result);
+        std::vector<double> cal_uncertainty(const ScoreFrame &scores, string mode, int result);
 
 };
 
@@ -8,12 +8,13 @@
  *****************************************************************************/
 #include "win.hpp"
 
-unsigned int Win_filter::analysis(const std::vector<float> &class_result, int mode, bool flex, int aa, int bb, int cc, int dd, int ee, int ff, int gg, int hh, int ii, int jj){
+unsigned int Win_filter::analysis(const ScoreFrame &scores, int mode, bool flex, int aa, int bb, int cc, int dd, int ee, int ff, int gg, int hh, int ii, int jj){
 /*
 	Main Wrapper function of the Window Filter. 
-	Stored recent classification result(the array class_result)and calculated the aggregate values based on that.
-	Final adjusted output = Position of max element in aggregated class_result array. 
+	Stored recent classification result(the softmax probabilities of scores)and calculated the aggregate values based on that.
+	Final adjusted output = Position of max element in aggregated probabilities array. 
 
+	@param scores: decoded output of the current frame (cleared if the frame was not classified)
 	@param mode: represents the level of uncertainty in data, depending on mode, various window filter configurations will be adopted if flex window setting is true
     @param flex: determines whether flex window filter setting is used.
     :return result_index: an integer representing a class(the adjusted output)
@@ -21,7 +22,7 @@ unsigned int Win_filter::analysis(const std::vector<float> &class_result, int mo
 	
 	//cout << "Mode: " << mode << endl;
 	if (!Win_filter::dropf()){
-		Win_filter::update_memory(class_result);
+		Win_filter::update_memory(scores);
 	}
 
 	//If base case is 15 fps, set to 9, if 30 fps, set to 4
@@ -78,11 +79,14 @@ unsigned int Win_filter::analysis(const std::vector<float> &class_result, int mo
 	unsigned int win_out;
 	if (wcount == (k-1)){
 		//cout << "CASE 3: just calculated aggregated values" << endl;
-		std::vector<float> adjusted_results(10, 0);
+		//as many classes as the newest entry, entries stored before a network switch are skipped
+		const unsigned int classes = wmemory.back().size();
+		std::vector<float> adjusted_results(classes, 0);
 
-		for (int i=0; i<10; i++ ){
+		for (unsigned int i=0; i<classes; i++ ){
 			for(int j = 0; j < wlength; j++){
-				adjusted_results[i] += (wweights[j] * wmemory[j][i]);
+				if (wmemory[j].size() == classes)
+					adjusted_results[i] += (wweights[j] * wmemory[j][i]);
 			} 
 		}
         win_out = distance(adjusted_results.begin(), max_element(adjusted_results.begin(), adjusted_results.end()));
@@ -105,50 +109,22 @@ unsigned int Win_filter::analysis(const std::vector<float> &class_result, int mo
 
 
 
-void Win_filter::update_memory(const std::vector<float> &class_result){
+void Win_filter::update_memory(const ScoreFrame &scores){
 /*
-	Update result history
+	Update result history, the oldest entry is recycled once the memory is full
 
-	@para class_result: result of the cuurent frame, to be inserted to the memory array
+	@para scores: result of the cuurent frame, its softmax probabilities are inserted to the memory array
 */
-	std::vector<float> softmax_out = Win_filter::calculate_softmax(class_result);
-	wmemory.push_back(softmax_out);
-    if (wmemory.size() > max_wlength)
-    {
-        wmemory.erase(wmemory.begin());
-    }
-}
-
-vector<float> Win_filter::calculate_softmax(const std::vector<float> &arg_vec){
-/*
-	Calculate softmax
-
-	@para arg_vec: input vector with floating points
-	:return: vector [e^(class1 probability)/sum, e^(class2 probability)/sum... e^(class10 probability)/sum], where sum = summation of e^(class probability) of all the classes
-*/
-
-	// Normalise the vector
-    std::vector<float> norm_vec(arg_vec.begin(), arg_vec.end());
-	int mx_n = *max_element(std::begin(norm_vec), std::end(norm_vec));
-	if (mx_n == 0){return arg_vec; } //if class result is a zero vector, resturen zero softmax
-	for(auto &elem : norm_vec)
-		elem = (float)elem / mx_n;
-
-	float mx = *max_element(std::begin(norm_vec), std::end(norm_vec));
-	float sum = 0;
-	for(auto const &elem : norm_vec)
-		sum += exp(elem);
-	
-	if(sum == 0){
-		std::cout << "Division by zero, sum = 0" << std::endl;
+	if (wmemory.size() < max_wlength){
+		wmemory.push_back(std::vector<float>(scores.classes));
+	} else {
+		std::rotate(wmemory.begin(), wmemory.begin() + 1, wmemory.end());
 	}
-	// Try to use OpenMP
-	for(int i=0; i<10;i++)
-	{
-		norm_vec[i] = exp(norm_vec[i]) / sum;
+	std::vector<float> &softmax_out = wmemory.back();
+	softmax_out.resize(scores.classes);
+	for (unsigned int i = 0; i < scores.classes; i++){
+		softmax_out[i] = scores.prob[i];
 	}
-
-	return norm_vec;
 }
 
 void Win_filter::init_weights(float lambda){
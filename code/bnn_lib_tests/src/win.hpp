@@ -12,6 +12,7 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include "score-frame.h"
 
 using namespace std;
 
@@ -19,9 +20,8 @@ class Win_filter{
     private:
         void print_vector(std::vector<float> &vec);
         float expDecay(float lambda, int t, int N = 1); //supporting math functions
-        vector<float> calculate_softmax(const std::vector<float> &arg_vec); //supporting math functions
         vector<int> select_ws_wl(int mode, int aa, int bb, int cc, int dd, int ee, int ff, int gg, int hh, int ii, int jj);
-        void update_memory(const std::vector<float> &class_result);
+        void update_memory(const ScoreFrame &scores);
         int display_c;
         bool display_f;
 
@@ -47,7 +47,7 @@ class Win_filter{
             bool winit = false;
         }
 
-        unsigned int analysis(const std::vector<float> &class_result, int mode, bool flex, int aa, int bb, int cc, int dd, int ee, int ff, int gg, int hh, int ii, int jj);
+        unsigned int analysis(const ScoreFrame &scores, int mode, bool flex, int aa, int bb, int cc, int dd, int ee, int ff, int gg, int hh, int ii, int jj);
         void init_weights(float lambda);
         bool dropf();
         bool processf();
@@ -33,10 +33,13 @@
 #include "tiny_cnn/layers/layer.h"
 #include "tiny_cnn/util/product.h"
 #include "tiny_cnn/activations/activation_function.h"
+#include "tiny_cnn/util/popcount.h"
+#include "tiny_cnn/util/bit_tensor.h"
 #include <vector>
 
 // function type for offload handling. args are (input, thresholds, weights, output)
-typedef void (*BinMatVecMult)(std::vector<bool>&, std::vector<unsigned int>&, std::vector<bool>&, std::vector<bool>&);
+// weights are packed one row per neuron, the output bits must be written
+typedef void (*BinMatVecMult)(const tiny_cnn::bit_tensor&, std::vector<unsigned int>&, const tiny_cnn::bit_matrix&, tiny_cnn::bit_tensor&);
 
 // implements a binarized fully-connected layer and "compacted" batch normalization
 // pretrained only, i.e. does not support training in tiny-cnn
@@ -46,26 +49,26 @@ typedef void (*BinMatVecMult)(std::vector<bool>&, std::vector<unsigned int>&, st
 namespace tiny_cnn {
 
 template<typename Activation>
-class binarynet_layer : public layer<Activation> {
+class binarynet_layer : public layer<Activation>, public bit_input_layer {
 public:
     typedef layer<Activation> Base;
     CNN_USE_LAYER_MEMBERS;
 
     binarynet_layer(cnn_size_t in_dim, cnn_size_t out_dim, BinMatVecMult offload = 0)
-        : Base(in_dim, out_dim, size_t(in_dim) * out_dim, 0), Offload_(offload) {
-        // initialize all binarized weights and thresholds
-        for(unsigned int i = 0; i < in_size_ * out_size_; i++) {
-            Wbin_.push_back(false);
-        }
-
+        : Base(in_dim, out_dim, size_t(in_dim) * out_dim, 0), Wbin_(out_dim, in_dim), Offload_(offload) {
+        // initialize all thresholds, the binarized weights start out cleared
         for(unsigned int i = 0; i < out_size_; i++) {
             Threshold_.push_back(0);
         }
+        for (auto& p : in_packed_) p.resize(in_dim);
+        for (auto& p : out_packed_) p.resize(out_dim);
     }
 
     // save/load
     virtual void save(std::ostream& os) const {
-        for (auto w : Wbin_) os << (w ? 1 : 0) << "\n";
+        for(unsigned int c = 0; c < in_size_; c++)
+            for(unsigned int i = 0; i < out_size_; i++)
+                os << (Wbin_.get(i, c) ? 1 : 0) << "\n";
         for (auto thr : Threshold_) os << thr << "\n";
     }
 
@@ -73,7 +76,7 @@ public:
         bool w;
         for(unsigned int i = 0; i < in_size_ * out_size_; i++) {
             is >> w;
-            Wbin_[i] = w;
+            Wbin_.set(i % out_size_, i / out_size_, w);
         }
         for (auto& thr : Threshold_) is >> thr;
     }
@@ -96,7 +99,8 @@ public:
 
     virtual void post_update() {
         // once the weights have been updated, update the binarized versions too
-        float2bipolar(W_, Wbin_);
+        for(unsigned int i = 0; i < W_.size(); i++)
+            Wbin_.set(i % out_size_, i / out_size_, W_[i] >= 0);
     }
 
     void set_threshold_from_batchnorm(size_t index, float_t mean, float_t gamma, float_t invstd, float_t beta) {
@@ -131,7 +135,7 @@ public:
         if((gamma*invstd) < 0) {
             thres = -thres;
             for (cnn_size_t c = 0; c < in_size_; c++) {
-                Wbin_[c*out_size_ + index] = !Wbin_[c*out_size_ + index];
+                Wbin_.flip(index, c);
             }
         }
         // ensure a positive threshold by averaging with the neuron fan-in
@@ -141,37 +145,41 @@ public:
     }
 
     const vec_t& forward_propagation(const vec_t& in, size_t index) override {
-        std::vector<bool> in_bin(in_size_, false);
         // explicitly binarize the input
-        float2bipolar(in, in_bin);
+        in_packed_[index].from_bipolar(in);
+        return forward_propagation_packed(in_packed_[index], index);
+    }
+
+    const vec_t& forward_propagation_packed(const bit_tensor& in, size_t index) override {
         vec_t &a = a_[index];
         vec_t &out = output_[index];
+        bit_tensor &res = out_packed_[index];
 
         if(Offload_ != 0) {
             // call offload hook to perform actual computation
-            std::vector<bool> res(out_size_, false);
-            Offload_(in_bin, Threshold_, Wbin_, res);
-            for(unsigned int i = 0; i < out_size_; i++)
-                out[i] = res[i] == 1 ? +1 : -1;
+            Offload_(in, Threshold_, Wbin_, res);
         } else {
             for_i(parallelize_, out_size_, [&](int i) {
-                a[i] = 0;
-                for (cnn_size_t c = 0; c < in_size_; c++) {
-                    // multiplication for binarized values is basically XNOR (equals)
-                    // i.e. if two values have the same sign (pos-pos or neg-neg)
-                    // we increment the popcount for this row
-                    a[i]  += (Wbin_[c*out_size_ + i] == in_bin[c]) ? +1 : 0;
-                }
-                // compute the activation by comparing against the threshold
-                // (the tiny-cnn specified act.fn. becomes unnecessary)
-                out[i] = a[i] >= Threshold_[i] ? +1 : -1;
+                // multiplication for binarized values is basically XNOR (equals)
+                // i.e. if two values have the same sign (pos-pos or neg-neg)
+                // we increment the popcount for this row
+                a[i] = float_t(xnor_popcount(Wbin_.row(i), in.data(), in_size_));
             });
+            // compute the activation by comparing against the threshold
+            // (the tiny-cnn specified act.fn. becomes unnecessary)
+            for(unsigned int i = 0; i < out_size_; i++)
+                res.set(i, a[i] >= Threshold_[i]);
         }
 
-
-
+        // the float output is kept current for anything reading the layer
+        res.to_bipolar(out);
         CNN_LOG_VECTOR(out, "[binarynet]forward");
 
+        // a binarized consumer takes the packed output as is
+        bit_input_layer * packedNext = dynamic_cast<bit_input_layer *>(next_);
+        if(packedNext)
+            return packedNext->forward_propagation_packed(res, index);
+
         return next_ ? next_->forward_propagation(out, index) : out;
     }
 
@@ -188,21 +196,12 @@ public:
     std::string layer_type() const override { return "binarynet-fully-connected"; }
 
 protected:
-    std::vector<bool> Wbin_;
+    // binarized weights, one packed row per neuron
+    bit_matrix Wbin_;
     std::vector<unsigned int> Threshold_;
     BinMatVecMult Offload_;
-
-    // utility function to convert a vector of floats into a vector of bools, where the
-    // output boolean represents the sign of the input value (false: negative,
-    // true: positive)
-    void float2bipolar(const vec_t & in, std::vector<bool> & out) {
-        for(unsigned int i = 0; i < in.size(); i++) {
-            out[i] = in[i] >= 0 ? true : false;
-        }
-    }
-
-
-
+    bit_tensor in_packed_[CNN_TASK_SIZE];
+    bit_tensor out_packed_[CNN_TASK_SIZE];
 };
 
 } // namespace tiny_cnn
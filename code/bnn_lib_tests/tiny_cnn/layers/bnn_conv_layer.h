@@ -34,13 +34,16 @@
 #include "tiny_cnn/layers/layer.h"
 #include "tiny_cnn/util/product.h"
 #include "tiny_cnn/activations/activation_function.h"
+#include "tiny_cnn/util/popcount.h"
+#include "tiny_cnn/util/bit_tensor.h"
+#include "tiny_cnn/util/sliding_window.h"
 #include <vector>
 #include <string>
 #include <iostream>
 
 namespace tiny_cnn {
 
-class bnn_conv_layer : public layer<activation::identity> {
+class bnn_conv_layer : public layer<activation::identity>, public bit_input_layer {
 public:
     typedef layer<activation::identity> Base;
 
@@ -54,13 +57,15 @@ public:
         : Base(in_width*in_height*in_channels, (in_width-window_size+1)*(in_height-window_size+1)*out_channels,
                out_channels*in_channels*window_size*window_size, 0),
           in_width_(in_width), in_height_(in_height), window_size_(window_size), in_channels_(in_channels), out_channels_(out_channels),
-          Wbin_(out_channels*in_channels*window_size*window_size, false),
+          Wbin_(out_channels, window_size*window_size*bit_words(in_channels)*64),
           usePopcount_(usePopcount)
     {
         // TODO re-enable parallelization -- need to support worker index in forward prop
         Base::set_parallelize(false);
         out_width_ = (in_width-window_size+1);
         out_height_ = (in_height-window_size+1);
+        for (auto& p : in_packed_) p.resize(in_size_);
+        for (auto& s : swu_) s.configure(in_width, in_height, window_size, in_channels);
 
         if(binaryParamFile != "")
           loadFromBinaryFile(binaryParamFile);
@@ -73,10 +78,11 @@ public:
       std::ifstream wf(fileName, std::ios::binary | std::ios::in);
       if(!wf.is_open())
         throw "Could not open file";
-      for(unsigned int line = 0 ; line < Wbin_.size(); line++) {
+      const unsigned int fanIn = fan_in_size();
+      for(unsigned int line = 0 ; line < Wbin_.rows() * fanIn; line++) {
         unsigned long long e = 0;
         wf.read((char *)&e, sizeof(unsigned long long));
-        Wbin_[line] = e == 1 ? true : false;
+        Wbin_.set(line / fanIn, swu_[0].bit_index(line % fanIn), e == 1);
       }
       wf.close();
     }
@@ -103,7 +109,9 @@ public:
 
     virtual void post_update() {
         // once the weights have been updated, update the binarized versions too
-        float2bipolar(W_, Wbin_);
+        const unsigned int fanIn = fan_in_size();
+        for(unsigned int i = 0; i < W_.size(); i++)
+            Wbin_.set(i / fanIn, swu_[0].bit_index(i % fanIn), W_[i] >= 0);
     }
 
     virtual const vec_t& back_propagation_2nd(const vec_t& current_delta2) override {
@@ -112,37 +120,37 @@ public:
 
     virtual const vec_t& forward_propagation(const vec_t& in_raw, size_t worker_index) override
     {
-        // turn the input into a vector of bools
-        std::vector<bool> in_bin(in_raw.size(), false);
-        float2bipolar(in_raw, in_bin);
+        // turn the input into packed bits
+        in_packed_[worker_index].from_bipolar(in_raw);
+        return forward_propagation_packed(in_packed_[worker_index], worker_index);
+    }
+
+    virtual const vec_t& forward_propagation_packed(const bit_tensor& in, size_t worker_index) override
+    {
         vec_t &out = output_[worker_index];
+        sliding_window_unit &swu = swu_[worker_index];
+        const unsigned int fanIn = fan_in_size();
+        const unsigned int runWords = swu.run_words();
 
-        // TODO implement actual binarized version
         // TODO support padding modes
         // TODO support worker index for parallelization
-        for(cnn_size_t oc = 0; oc < out_channels_; oc++) {
-            unsigned int output_base = oc * out_height_ * out_width_;
-            for(cnn_size_t oy = 0; oy < out_height_; oy++) {
-                for(cnn_size_t ox = 0; ox < out_width_; ox++) {
-                    int acc = 0;
-                    for(cnn_size_t ic = 0; ic < in_channels_; ic++) {
-                        unsigned int weight_base = oc*(window_size_*window_size_*in_channels_) + (window_size_*window_size_*ic);
-                        unsigned int input_base = ic*(in_width_*in_height_) + oy*in_width_ + ox;
-                        for(cnn_size_t ky = 0; ky < window_size_; ky++) {
-                            for(cnn_size_t kx = 0; kx < window_size_; kx++) {
-                                unsigned int weight_ind = weight_base + ky*window_size_ + kx;
-                                unsigned int input_ind = input_base + ky*in_width_ + kx;
-                                if(usePopcount_) {
-                                    // accumulate popcount (+1 bits) only
-                                    acc += Wbin_[weight_ind] == in_bin[input_ind] ? +1 : 0;
-                                } else {
-                                    // accumulate sum of +1 and -1s
-                                    acc += Wbin_[weight_ind] == in_bin[input_ind] ? +1 : -1;
-                                }
-                            }
-                        }
+        swu.start(in);
+        for(cnn_size_t oy = 0; oy < out_height_; oy++) {
+            swu.advance(oy);
+            for(cnn_size_t ox = 0; ox < out_width_; ox++) {
+                for(cnn_size_t oc = 0; oc < out_channels_; oc++) {
+                    // XNOR-popcount against the packed weights of this output
+                    // channel, one window run at a time straight from the SWU lines
+                    const uint64_t * w = Wbin_.row(oc);
+                    size_t mismatches = 0;
+                    for(cnn_size_t ky = 0; ky < window_size_; ky++)
+                        mismatches += xor_popcount(w + ky * runWords, swu.window_run(ox, ky), runWords);
+                    int acc = (int)(fanIn - mismatches);
+                    if(!usePopcount_) {
+                        // sum of +1 and -1s
+                        acc = 2 * acc - (int)fanIn;
                     }
-                    unsigned int output_ind = output_base + oy * out_width_ + ox;
+                    unsigned int output_ind = oc * out_height_ * out_width_ + oy * out_width_ + ox;
                     out[output_ind] = acc;
                 }
             }
@@ -159,7 +167,9 @@ public:
 
 protected:
     bool usePopcount_;
-    std::vector<bool> Wbin_;
+    // binarized weights, one packed row per output channel in the window
+    // order of the sliding window unit
+    bit_matrix Wbin_;
     cnn_size_t in_width_;
     cnn_size_t in_height_;
     cnn_size_t window_size_;
@@ -167,14 +177,8 @@ protected:
     cnn_size_t out_channels_;
     cnn_size_t out_width_;
     cnn_size_t out_height_;
-
-    // utility function to convert a vector of floats into a vector of bools, where the
-    // output boolean represents the sign of the input value (false: negative,
-    // true: positive)
-    void float2bipolar(const vec_t & in, std::vector<bool> & out) {
-        for(unsigned int i = 0; i < in.size(); i++)
-            out[i] = in[i] >= 0 ? true : false;
-    }
+    bit_tensor in_packed_[CNN_TASK_SIZE];
+    sliding_window_unit swu_[CNN_TASK_SIZE];
 };
 
 }
@@ -32,6 +32,8 @@
 #pragma once
 #include "tiny_cnn/layers/layer.h"
 #include "tiny_cnn/util/product.h"
+#include "tiny_cnn/util/popcount.h"
+#include "tiny_cnn/util/bit_tensor.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -39,15 +41,16 @@
 namespace tiny_cnn {
 
 template<typename Activation>
-class bnn_fc_layer : public layer<Activation> {
+class bnn_fc_layer : public layer<Activation>, public bit_input_layer {
 public:
     typedef layer<Activation> Base;
     CNN_USE_LAYER_MEMBERS;
 
     bnn_fc_layer(cnn_size_t in_dim, cnn_size_t out_dim,
                  bool usePopcount = false, bool rowMajorWeights = false, std::string binaryParamFile = "")
-        : Base(in_dim, out_dim, size_t(in_dim) * out_dim, 0), Wbin_(in_dim*out_dim, false),
+        : Base(in_dim, out_dim, size_t(in_dim) * out_dim, 0), Wbin_(out_dim, in_dim),
           usePopcount_(usePopcount), rowMajorWeights_(rowMajorWeights) {
+        for (auto& p : in_packed_) p.resize(in_dim);
         if(binaryParamFile != "")
           loadFromBinaryFile(binaryParamFile);
     }
@@ -59,10 +62,10 @@ public:
       std::ifstream wf(fileName, std::ios::binary | std::ios::in);
       if(!wf.is_open())
         throw "Could not open file";
-      for(unsigned int line = 0 ; line < Wbin_.size(); line++) {
+      for(unsigned int line = 0 ; line < in_size_ * out_size_; line++) {
         unsigned long long e = 0;
         wf.read((char *)&e, sizeof(unsigned long long));
-        Wbin_[line] = e == 1 ? true : false;
+        setWeight(line, e == 1);
       }
       wf.close();
     }
@@ -81,29 +84,30 @@ public:
 
     virtual void post_update() {
         // once the weights have been updated, update the binarized versions too
-        float2bipolar(W_, Wbin_);
+        for(unsigned int i = 0; i < W_.size(); i++)
+            setWeight(i, W_[i] >= 0);
     }
 
     const vec_t& forward_propagation(const vec_t& in, size_t index) override {
-        std::vector<bool> in_bin(in_size_, false);
         // explicitly binarize the input
-        float2bipolar(in, in_bin);
+        in_packed_[index].from_bipolar(in);
+        return forward_propagation_packed(in_packed_[index], index);
+    }
+
+    const vec_t& forward_propagation_packed(const bit_tensor& in, size_t index) override {
         vec_t &a = a_[index];
         vec_t &out = output_[index];
 
         for_i(parallelize_, out_size_, [&](int i) {
-            a[i] = float_t(0);
-            for (cnn_size_t c = 0; c < in_size_; c++) {
-                // multiplication for binarized values is basically XNOR (equals)
-                // i.e. if two values have the same sign (pos-pos or neg-neg)
-                // the mul. result will be positive, otherwise negative
-                // when using the popcount mode, consider positive results only
-                const unsigned int wInd = rowMajorWeights_ ? i*in_size_+c : c*out_size_+i;
-                if(usePopcount_)
-                  a[i]  += (Wbin_[wInd] == in_bin[c]) ? +1 : 0;
-                else
-                  a[i]  += (Wbin_[wInd] == in_bin[c]) ? +1 : -1;
-            }
+            // multiplication for binarized values is basically XNOR (equals)
+            // i.e. if two values have the same sign (pos-pos or neg-neg)
+            // the mul. result will be positive, otherwise negative
+            // when using the popcount mode, consider positive results only
+            const int matches = (int)xnor_popcount(Wbin_.row(i), in.data(), in_size_);
+            if(usePopcount_)
+              a[i] = float_t(matches);
+            else
+              a[i] = float_t(2 * matches - (int)in_size_);
         });
 
         for_i(parallelize_, out_size_, [&](int i) {
@@ -127,15 +131,17 @@ public:
     std::string layer_type() const override { return "bnn_fc_layer"; }
 
 protected:
-    std::vector<bool> Wbin_;
+    // binarized weights, one packed row per neuron
+    bit_matrix Wbin_;
     bool usePopcount_, rowMajorWeights_;
-
-    // utility function to convert a vector of floats into a vector of bools, where the
-    // output boolean represents the sign of the input value (false: negative,
-    // true: positive)
-    void float2bipolar(const vec_t & in, std::vector<bool> & out) {
-        for(unsigned int i = 0; i < in.size(); i++)
-            out[i] = in[i] >= 0 ? true : false;
+    bit_tensor in_packed_[CNN_TASK_SIZE];
+
+    // set weight number ind in the order of the parameter file / W_
+    void setWeight(unsigned int ind, bool w) {
+        if(rowMajorWeights_)
+            Wbin_.set(ind / in_size_, ind % in_size_, w);
+        else
+            Wbin_.set(ind % out_size_, ind / out_size_, w);
     }
 
 };
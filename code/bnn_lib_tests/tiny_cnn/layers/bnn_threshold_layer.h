@@ -33,6 +33,7 @@
 #include "tiny_cnn/layers/layer.h"
 #include "tiny_cnn/activations/activation_function.h"
 #include "tiny_cnn/util/util.h"
+#include "tiny_cnn/util/bit_tensor.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -50,6 +51,7 @@ public:
     {
       // TODO re-enable parallelization -- need to support worker index in forward prop
       set_parallelize(false);
+      for (auto& p : out_packed_) p.resize(dim*channels);
       if(binaryParamFile != "")
         loadFromBinaryFile(binaryParamFile);
     }
@@ -94,17 +96,23 @@ public:
 
     const vec_t& forward_propagation(const vec_t& in, size_t index) override {
         vec_t &out = output_[index];
+        bit_tensor &res = out_packed_[index];
 
+        // the float output is kept current for anything reading the layer,
+        // the packed one is what a binarized consumer takes
         for(unsigned int ch = 0; ch < channels_; ch++) {
           for(unsigned int j = 0; j < dim_; j++) {
               unsigned int pos = ch*dim_ + j;
-              out[pos] = (in[pos] > thresholds_[ch] ? +1 : -1);
-
-              if(invertOutput_[ch])
-                  out[pos] = -out[pos];
+              const bool bit = (in[pos] > thresholds_[ch]) != invertOutput_[ch];
+              out[pos] = bit ? +1 : -1;
+              res.set(pos, bit);
           }
         }
 
+        bit_input_layer * packedNext = dynamic_cast<bit_input_layer *>(next_);
+        if(packedNext)
+          return packedNext->forward_propagation_packed(res, index);
+
         return next_ ? next_->forward_propagation(out, index) : out;
     }
 
@@ -127,6 +135,7 @@ protected:
 
     std::vector<int> thresholds_;
     std::vector<bool> invertOutput_;
+    bit_tensor out_packed_[CNN_TASK_SIZE];
 };
 
 } // namespace tiny_cnn
@@ -0,0 +1,134 @@
+/******************************************************************************
+ *
+ *
+ * @file bit_tensor.h
+ *
+ * Packed storage for binarized values: 64 values per word, a set bit is +1
+ * and a cleared bit is -1. Rows are cache line aligned so the popcount
+ * kernels of popcount.h can stream them directly. Used for the weights of
+ * the binarized layers and for the activations passed between them.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "aligned_allocator.h"
+#include "util.h"
+
+namespace tiny_cnn {
+
+typedef std::vector<uint64_t, aligned_allocator<uint64_t, 64> > packed_vec_t;
+
+inline size_t bit_words(size_t bits) {
+    return (bits + 63) / 64;
+}
+
+// reads n <= 64 bits starting at bit position pos of a packed row
+inline uint64_t extract_bits(const uint64_t * src, size_t pos, size_t n) {
+    const size_t w = pos / 64, s = pos % 64;
+    uint64_t v = src[w] >> s;
+    if (s + n > 64)
+        v |= src[w + 1] << (64 - s);
+    return n == 64 ? v : v & (((uint64_t)1 << n) - 1);
+}
+
+// ORs n <= 64 bits (the high bits of v must be zero) in at bit position pos
+inline void insert_bits(uint64_t * dst, size_t pos, uint64_t v, size_t n) {
+    const size_t w = pos / 64, s = pos % 64;
+    dst[w] |= v << s;
+    if (s + n > 64)
+        dst[w + 1] |= v >> (64 - s);
+}
+
+// a vector of binarized values
+class bit_tensor {
+public:
+    bit_tensor() : bits_(0) {}
+    explicit bit_tensor(size_t bits) { resize(bits); }
+
+    void resize(size_t bits) {
+        bits_ = bits;
+        words_.assign(bit_words(bits), 0);
+    }
+
+    void clear() { std::fill(words_.begin(), words_.end(), 0); }
+
+    size_t size() const { return bits_; }
+    size_t words() const { return words_.size(); }
+    uint64_t * data() { return words_.data(); }
+    const uint64_t * data() const { return words_.data(); }
+
+    bool get(size_t i) const { return (words_[i / 64] >> (i % 64)) & 1; }
+    void set(size_t i, bool v) {
+        if (v) words_[i / 64] |= (uint64_t)1 << (i % 64);
+        else   words_[i / 64] &= ~((uint64_t)1 << (i % 64));
+    }
+
+    // binarize by sign, values >= 0 become +1
+    void from_bipolar(const vec_t & in) {
+        bits_ = in.size();
+        words_.resize(bit_words(bits_));
+        for (size_t w = 0; w < words_.size(); w++) {
+            const size_t n = std::min<size_t>(64, bits_ - w * 64);
+            uint64_t v = 0;
+            for (size_t b = 0; b < n; b++)
+                v |= (uint64_t)(in[w * 64 + b] >= 0) << b;
+            words_[w] = v;
+        }
+    }
+
+    void to_bipolar(vec_t & out) const {
+        out.resize(bits_);
+        for (size_t i = 0; i < bits_; i++)
+            out[i] = get(i) ? float_t(+1) : float_t(-1);
+    }
+
+private:
+    size_t bits_;
+    packed_vec_t words_;
+};
+
+// a matrix of binarized values with each row padded to whole, zero filled
+// words, so any two rows of equal length can be XNOR-popcounted directly
+class bit_matrix {
+public:
+    bit_matrix() : rows_(0), cols_(0), words_per_row_(0) {}
+    bit_matrix(size_t rows, size_t cols) { resize(rows, cols); }
+
+    void resize(size_t rows, size_t cols) {
+        rows_ = rows;
+        cols_ = cols;
+        words_per_row_ = bit_words(cols);
+        words_.assign(rows * words_per_row_, 0);
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    size_t words_per_row() const { return words_per_row_; }
+    uint64_t * row(size_t r) { return &words_[r * words_per_row_]; }
+    const uint64_t * row(size_t r) const { return &words_[r * words_per_row_]; }
+
+    bool get(size_t r, size_t c) const { return (row(r)[c / 64] >> (c % 64)) & 1; }
+    void set(size_t r, size_t c, bool v) {
+        if (v) row(r)[c / 64] |= (uint64_t)1 << (c % 64);
+        else   row(r)[c / 64] &= ~((uint64_t)1 << (c % 64));
+    }
+    void flip(size_t r, size_t c) { row(r)[c / 64] ^= (uint64_t)1 << (c % 64); }
+
+private:
+    size_t rows_, cols_, words_per_row_;
+    packed_vec_t words_;
+};
+
+// implemented by layers that can consume binarized activations in packed
+// form, so a binarizing layer can hand its output over without expanding
+// it back to floats
+class bit_input_layer {
+public:
+    virtual ~bit_input_layer() = default;
+    virtual const vec_t& forward_propagation_packed(const bit_tensor& in, size_t worker_index) = 0;
+};
+
+} // namespace tiny_cnn
@@ -0,0 +1,156 @@
+/******************************************************************************
+ *
+ *
+ * @file popcount.h
+ *
+ * XNOR-popcount kernels over rows of 64-bit packed binary values, used by the
+ * binarized layers and the software backend. The widest variant supported by
+ * the host (AVX-512 VPOPCNTDQ, AVX2, NEON) is picked once at startup, with a
+ * portable scalar version as reference and fallback.
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CNN_POPCOUNT_X86
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CNN_POPCOUNT_NEON
+#include <arm_neon.h>
+#endif
+
+namespace tiny_cnn {
+
+// number of differing bits between two packed rows of the given length in words
+typedef size_t (*xor_popcount_fn)(const uint64_t * a, const uint64_t * b, size_t words);
+
+namespace detail {
+
+inline size_t xor_popcount_scalar(const uint64_t * a, const uint64_t * b, size_t words) {
+    size_t cnt = 0;
+    for (size_t i = 0; i < words; i++)
+        cnt += __builtin_popcountll(a[i] ^ b[i]);
+    return cnt;
+}
+
+#ifdef CNN_POPCOUNT_X86
+// per-byte popcount through a nibble lookup table (vpshufb), summed into the
+// four 64-bit lanes with vpsadbw
+__attribute__((target("avx2")))
+inline __m256i popcount_bytes_avx2(__m256i v) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_add_epi8(lo, hi);
+}
+
+__attribute__((target("avx2")))
+inline size_t xor_popcount_avx2(const uint64_t * a, const uint64_t * b, size_t words) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    // two vectors per iteration, byte counts are at most 16 before the sad
+    for (; i + 8 <= words; i += 8) {
+        __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                      _mm256_loadu_si256((const __m256i *)(b + i)));
+        __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i + 4)),
+                                      _mm256_loadu_si256((const __m256i *)(b + i + 4)));
+        __m256i c = _mm256_add_epi8(popcount_bytes_avx2(x0), popcount_bytes_avx2(x1));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(c, _mm256_setzero_si256()));
+    }
+    for (; i + 4 <= words; i += 4) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                     _mm256_loadu_si256((const __m256i *)(b + i)));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(popcount_bytes_avx2(x), _mm256_setzero_si256()));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    size_t cnt = (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    for (; i < words; i++)
+        cnt += __builtin_popcountll(a[i] ^ b[i]);
+    return cnt;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+inline size_t xor_popcount_avx512(const uint64_t * a, const uint64_t * b, size_t words) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= words; i += 8) {
+        __m512i x = _mm512_xor_si512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+    }
+    if (i < words) {
+        // masked load of the tail, the inactive lanes read as zero
+        __mmask8 m = (__mmask8)((1u << (words - i)) - 1);
+        __m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi64(m, a + i), _mm512_maskz_loadu_epi64(m, b + i));
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+    }
+    return (size_t)_mm512_reduce_add_epi64(acc);
+}
+#endif
+
+#ifdef CNN_POPCOUNT_NEON
+inline size_t xor_popcount_neon(const uint64_t * a, const uint64_t * b, size_t words) {
+    uint64x2_t acc = vdupq_n_u64(0);
+    size_t i = 0;
+    for (; i + 2 <= words; i += 2) {
+        uint8x16_t x = veorq_u8(vld1q_u8((const uint8_t *)(a + i)), vld1q_u8((const uint8_t *)(b + i)));
+        acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(vcntq_u8(x))));
+    }
+    size_t cnt = (size_t)(vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1));
+    for (; i < words; i++)
+        cnt += __builtin_popcountll(a[i] ^ b[i]);
+    return cnt;
+}
+#endif
+
+inline xor_popcount_fn select_xor_popcount() {
+#ifdef CNN_POPCOUNT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vpopcntdq"))
+        return xor_popcount_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return xor_popcount_avx2;
+#endif
+#ifdef CNN_POPCOUNT_NEON
+    return xor_popcount_neon;
+#endif
+    return xor_popcount_scalar;
+}
+
+} // namespace detail
+
+// kernel chosen for this host, resolved on first use
+inline xor_popcount_fn xor_popcount_kernel() {
+    static const xor_popcount_fn fn = detail::select_xor_popcount();
+    return fn;
+}
+
+inline size_t xor_popcount(const uint64_t * a, const uint64_t * b, size_t words) {
+    return xor_popcount_kernel()(a, b, words);
+}
+
+// number of equal bits between two packed rows of `bits` synapses, the
+// padding bits past `bits` must be zero in both rows
+inline size_t xnor_popcount(const uint64_t * a, const uint64_t * b, size_t bits) {
+    return bits - xor_popcount(a, b, (bits + 63) / 64);
+}
+
+inline const char * xor_popcount_kernel_name() {
+    xor_popcount_fn fn = xor_popcount_kernel();
+#ifdef CNN_POPCOUNT_X86
+    if (fn == detail::xor_popcount_avx512) return "avx512-vpopcntdq";
+    if (fn == detail::xor_popcount_avx2) return "avx2";
+#endif
+#ifdef CNN_POPCOUNT_NEON
+    if (fn == detail::xor_popcount_neon) return "neon";
+#endif
+    return "scalar";
+}
+
+} // namespace tiny_cnn
@@ -0,0 +1,116 @@
+/******************************************************************************
+ *
+ *
+ * @file sliding_window.h
+ *
+ * Software counterpart of the FINN sliding window unit (SWU) for binarized
+ * convolutions. The channel-major packed input map is transposed one image
+ * row at a time into a K-row line buffer that holds each pixel's channels
+ * as whole 64-bit words. The window of an output pixel is then K runs of
+ * K pixels, each contiguous in its line, which the popcount kernels read in
+ * place: nothing is copied per output pixel, and every input bit is
+ * transposed once instead of K*K times.
+ *
+ * A window is ordered (ky, kx, ic) with each pixel padded to whole words.
+ * Weights have to be laid out the same way, see bit_index().
+ *
+ *
+ *****************************************************************************/
+#pragma once
+#include <string.h>
+#include <algorithm>
+#include "bit_tensor.h"
+
+namespace tiny_cnn {
+
+class sliding_window_unit {
+public:
+    sliding_window_unit()
+        : in_width_(0), in_height_(0), window_size_(0), channels_(0), words_per_pixel_(0) {}
+
+    sliding_window_unit(size_t in_width, size_t in_height, size_t window_size, size_t channels) {
+        configure(in_width, in_height, window_size, channels);
+    }
+
+    void configure(size_t in_width, size_t in_height, size_t window_size, size_t channels) {
+        in_width_ = in_width;
+        in_height_ = in_height;
+        window_size_ = window_size;
+        channels_ = channels;
+        words_per_pixel_ = bit_words(channels);
+        lines_.assign(window_size * in_width * words_per_pixel_, 0);
+    }
+
+    size_t out_width() const { return in_width_ - window_size_ + 1; }
+    size_t out_height() const { return in_height_ - window_size_ + 1; }
+    size_t words_per_pixel() const { return words_per_pixel_; }
+    // words in one window run (K pixels of one line)
+    size_t run_words() const { return window_size_ * words_per_pixel_; }
+    // words in a whole window, also the padded width of a weight row
+    size_t row_words() const { return window_size_ * run_words(); }
+    size_t row_bits() const { return row_words() * 64; }
+
+    // position in a window of input channel ic at window offset (ky, kx)
+    size_t bit_index(size_t ic, size_t ky, size_t kx) const {
+        return (ky * window_size_ + kx) * words_per_pixel_ * 64 + ic;
+    }
+
+    // maps the (ic, ky, kx) order used by the weight files to bit_index()
+    size_t bit_index(size_t synapse) const {
+        const size_t kk = window_size_ * window_size_;
+        return bit_index(synapse / kk, (synapse % kk) / window_size_, synapse % window_size_);
+    }
+
+    // starts on a new channel-major [ic][y][x] map by filling the first K-1 lines
+    void start(const bit_tensor & in) {
+        in_ = &in;
+        for (size_t y = 0; y + 1 < window_size_; y++)
+            load_line(y);
+    }
+
+    // makes output row oy available, oy has to advance by one from 0
+    void advance(size_t oy) {
+        load_line(oy + window_size_ - 1);
+        oy_ = oy;
+    }
+
+    // run ky of the window of output pixel (ox, oy) for the current row,
+    // run_words() words that stay valid until the next advance()
+    const uint64_t * window_run(size_t ox, size_t ky) {
+        return line(oy_ + ky) + ox * words_per_pixel_;
+    }
+
+private:
+    uint64_t * line(size_t y) {
+        return &lines_[(y % window_size_) * in_width_ * words_per_pixel_];
+    }
+
+    // transposes image row y into its line buffer slot, reading the row of
+    // each channel 64 pixels at a time and scattering only the set bits
+    void load_line(size_t y) {
+        uint64_t * dst = line(y);
+        memset(dst, 0, in_width_ * words_per_pixel_ * sizeof(uint64_t));
+        const uint64_t * src = in_->data();
+        for (size_t ic = 0; ic < channels_; ic++) {
+            const size_t base = (ic * in_height_ + y) * in_width_;
+            const uint64_t chanBit = (uint64_t)1 << (ic % 64);
+            uint64_t * chanWord = dst + ic / 64;
+            for (size_t x = 0; x < in_width_; x += 64) {
+                const size_t n = std::min<size_t>(64, in_width_ - x);
+                uint64_t v = extract_bits(src, base + x, n);
+                while (v) {
+                    const size_t b = __builtin_ctzll(v);
+                    chanWord[(x + b) * words_per_pixel_] |= chanBit;
+                    v &= v - 1;
+                }
+            }
+        }
+    }
+
+    size_t in_width_, in_height_, window_size_, channels_, words_per_pixel_;
+    size_t oy_ = 0;
+    const bit_tensor * in_ = nullptr;
+    packed_vec_t lines_;
+};
+
+} // namespace tiny_cnn